@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QObject>
+
+// user type instantiated for the "$type": "BenchStyle" objects of generated configs
+class BenchStyle : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
+    Q_PROPERTY(QString color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(int size READ size WRITE setSize NOTIFY sizeChanged)
+
+public:
+    Q_INVOKABLE explicit BenchStyle(QObject *parent = nullptr)
+        : QObject(parent)
+    {}
+
+    QString name() const { return m_name; }
+    QString color() const { return m_color; }
+    int size() const { return m_size; }
+
+    void setName(const QString &name)
+    {
+        if (m_name != name) {
+            m_name = name;
+            emit nameChanged();
+        }
+    }
+
+    void setColor(const QString &color)
+    {
+        if (m_color != color) {
+            m_color = color;
+            emit colorChanged();
+        }
+    }
+
+    void setSize(int size)
+    {
+        if (m_size != size) {
+            m_size = size;
+            emit sizeChanged();
+        }
+    }
+
+signals:
+    void nameChanged();
+    void colorChanged();
+    void sizeChanged();
+
+private:
+    QString m_name;
+    QString m_color;
+    int m_size = 0;
+};
+
+Q_DECLARE_METATYPE(BenchStyle*)
@@ -0,0 +1,219 @@
+#include "configgenerator.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+#include <QDebug>
+
+#include <cmath>
+
+namespace {
+
+// layer files repeat the same colors over and over, as theme layers do
+QString color(int index)
+{
+    return QStringLiteral("#%1").arg((index % 64) * 0x030303 + 0x202020, 6, 16, QLatin1Char('0')).toUpper();
+}
+
+}
+
+ConfigGenerator::ConfigGenerator(const Options &options)
+    : m_options(options)
+{
+    m_options.keys = qMax(1, m_options.keys);
+    m_options.depth = qMax(1, m_options.depth);
+    m_fanout = qMax(1, int(std::ceil(std::pow(double(m_options.keys), 1.0 / m_options.depth))));
+    // guard against pow() rounding, the tree must be able to hold all the keys
+    auto capacity = [this] {
+        qint64 c = 1;
+        for (int i = 0; i < m_options.depth; ++i) {
+            c *= m_fanout;
+        }
+        return c;
+    };
+    while (capacity() < m_options.keys) {
+        ++m_fanout;
+    }
+    generateKinds();
+}
+
+QJsonObject ConfigGenerator::root() const
+{
+    return buildRoot(0, m_options.keys, 0, QString());
+}
+
+QJsonObject ConfigGenerator::layer(int index) const
+{
+    QRandomGenerator rng(m_options.seed + 7919 * quint32(index + 1));
+    return buildLayer(0, m_options.keys, 0, index, &rng);
+}
+
+QStringList ConfigGenerator::keys(ValueKind kind) const
+{
+    QStringList ret;
+    for (int i = 0; i < m_kinds.size(); ++i) {
+        if (m_kinds[i] == kind) {
+            ret.append(keyPath(i));
+        }
+    }
+    return ret;
+}
+
+QStringList ConfigGenerator::valueKeys() const
+{
+    QStringList ret;
+    for (int i = 0; i < m_kinds.size(); ++i) {
+        if (m_kinds[i] != Ref && m_kinds[i] != Typed) {
+            ret.append(keyPath(i));
+        }
+    }
+    return ret;
+}
+
+bool ConfigGenerator::writeFile(const QString &path, const QJsonObject &object)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning().noquote() << "Failed to open file" << path << "for writing:" << f.errorString();
+        return false;
+    }
+    return f.write(QJsonDocument(object).toJson(QJsonDocument::Indented)) != -1;
+}
+
+const char *ConfigGenerator::typeName()
+{
+    return "BenchStyle";
+}
+
+void ConfigGenerator::generateKinds()
+{
+    QRandomGenerator rng(m_options.seed);
+    QVector<int> values;
+    m_kinds.resize(m_options.keys);
+    m_refTargets.fill(-1, m_options.keys);
+    for (int i = 0; i < m_options.keys; ++i) {
+        double r = rng.generateDouble();
+        if (r < m_options.refDensity && !values.isEmpty()) {
+            // refs point to plain values only, so the generated configs never contain cycles
+            m_kinds[i] = Ref;
+            m_refTargets[i] = values[int(rng.bounded(quint32(values.size())))];
+            continue;
+        }
+        r -= m_options.refDensity;
+        if (r >= 0 && r < m_options.typeDensity) {
+            m_kinds[i] = Typed;
+            continue;
+        }
+        // mix of value types roughly following real-world theme configs
+        quint32 t = rng.bounded(100u);
+        m_kinds[i] = t < 35 ? Integer : t < 55 ? Double : t < 70 ? Bool : t < 95 ? String : Array;
+        values.append(i);
+    }
+}
+
+QJsonObject ConfigGenerator::buildRoot(int first, int count, int level, const QString &path) const // NOLINT
+{
+    QJsonObject ret;
+    if (level == m_options.depth - 1) {
+        for (int i = 0; i < count; ++i) {
+            int key = first + i;
+            QString name = QStringLiteral("k%1").arg(i);
+            switch (m_kinds[key]) {
+            case Ref: {
+                QString target = keyPath(m_refTargets[key]);
+                ret.insert(name, QJsonObject { { "$ref", "#/" + target.replace(QLatin1Char('.'), QLatin1Char('/')) } });
+                break;
+            }
+            case Typed:
+                ret.insert(name, QJsonObject {
+                               { "$type", QLatin1String(typeName()) },
+                               { "name", path + name },
+                               { "color", color(key) },
+                               { "size", 8 + key % 16 } });
+                break;
+            default:
+                ret.insert(name, value(key, 0));
+                break;
+            }
+        }
+        return ret;
+    }
+    qint64 span = 1;
+    for (int i = level + 1; i < m_options.depth; ++i) {
+        span *= m_fanout;
+    }
+    for (int j = 0; j < m_fanout && qint64(j) * span < count; ++j) {
+        int childFirst = first + int(j * span);
+        int childCount = int(qMin<qint64>(span, count - j * span));
+        QString name = QStringLiteral("s%1").arg(j);
+        ret.insert(name, buildRoot(childFirst, childCount, level + 1, path + name + '.')); // NOLINT
+    }
+    return ret;
+}
+
+QJsonObject ConfigGenerator::buildLayer(int first, int count, int level, int layer, QRandomGenerator *rng) const // NOLINT
+{
+    QJsonObject ret;
+    if (level == m_options.depth - 1) {
+        for (int i = 0; i < count; ++i) {
+            int key = first + i;
+            if (m_kinds[key] == Ref || rng->generateDouble() >= m_options.overrideRatio) {
+                continue;
+            }
+            QString name = QStringLiteral("k%1").arg(i);
+            if (m_kinds[key] == Typed) {
+                ret.insert(name, QJsonObject { { "size", 8 + (key + layer + 1) % 16 } });
+            } else {
+                ret.insert(name, value(key, layer + 1));
+            }
+        }
+        return ret;
+    }
+    qint64 span = 1;
+    for (int i = level + 1; i < m_options.depth; ++i) {
+        span *= m_fanout;
+    }
+    for (int j = 0; j < m_fanout && qint64(j) * span < count; ++j) {
+        QJsonObject child = buildLayer(first + int(j * span), int(qMin<qint64>(span, count - j * span)), level + 1, layer, rng); // NOLINT
+        if (!child.isEmpty()) {
+            ret.insert(QStringLiteral("s%1").arg(j), child);
+        }
+    }
+    return ret;
+}
+
+QString ConfigGenerator::keyPath(int key) const
+{
+    QString ret;
+    qint64 span = 1;
+    for (int i = 1; i < m_options.depth; ++i) {
+        span *= m_fanout;
+    }
+    int rest = key;
+    for (int level = 0; level < m_options.depth - 1; ++level) {
+        ret += QStringLiteral("s%1.").arg(rest / span);
+        rest %= span;
+        span /= m_fanout;
+    }
+    return ret + QStringLiteral("k%1").arg(rest);
+}
+
+QJsonValue ConfigGenerator::value(int key, int variant) const
+{
+    switch (m_kinds[key]) {
+    case Integer:
+        return (key * 7 + variant * 13) % 1000;
+    case Double:
+        // keep a fractional part, otherwise the value is written and read back as an integer
+        return (key % 100) / 8.0 + variant + 0.0625;
+    case Bool:
+        return (key + variant) % 2 == 0;
+    case String:
+        return color(key + variant);
+    case Array:
+        return QJsonArray { variant, key % 10, key % 7 };
+    default:
+        return {};
+    }
+}
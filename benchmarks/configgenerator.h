@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QStringList>
+#include <QVector>
+
+class QRandomGenerator;
+
+// Generates synthetic configs for the benchmarks. The root config has the requested number of keys spread over
+// nested sections, with a share of $ref values pointing to other keys and of $type objects. Override layers
+// replace a share of the plain values of the root with values of the same type.
+class ConfigGenerator
+{
+public:
+    struct Options
+    {
+        int keys = 1000;
+        int depth = 3;
+        double refDensity = 0.05;
+        double typeDensity = 0.01;
+        double overrideRatio = 0.1;
+        quint32 seed = 1;
+    };
+
+    enum ValueKind : quint8
+    {
+        Integer,
+        Double,
+        Bool,
+        String,
+        Array,
+        Ref,
+        Typed
+    };
+
+    explicit ConfigGenerator(const Options &options);
+
+    QJsonObject root() const;
+    QJsonObject layer(int index) const;
+
+    // dotted paths of the keys of the given kind, in document order
+    QStringList keys(ValueKind kind) const;
+    // dotted paths of plain (non-ref, non-typed) values
+    QStringList valueKeys() const;
+
+    static bool writeFile(const QString &path, const QJsonObject &object);
+    static const char *typeName();
+
+private:
+    void generateKinds();
+    QJsonObject buildRoot(int first, int count, int level, const QString &path) const;
+    QJsonObject buildLayer(int first, int count, int level, int layer, QRandomGenerator *rng) const;
+    QString keyPath(int key) const;
+    QJsonValue value(int key, int variant) const;
+
+    Options m_options;
+    int m_fanout = 1;
+    QVector<ValueKind> m_kinds;
+    QVector<int> m_refTargets;
+};
@@ -0,0 +1,584 @@
+#include <QtTest>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QQmlComponent>
+#include <QQmlEngine>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+
+#include <memory>
+
+#include "jsonconfig.h"
+#include "benchstyle.h"
+#include "configgenerator.h"
+
+namespace {
+
+// number of keys read or written per benchmark iteration
+constexpr int SampleSize = 1000;
+
+QStringList sample(const QStringList &keys)
+{
+    if (keys.size() <= SampleSize) {
+        return keys;
+    }
+    QStringList ret;
+    ret.reserve(SampleSize);
+    for (int i = 0; i < SampleSize; ++i) {
+        ret.append(keys[int(qint64(i) * keys.size() / SampleSize)]);
+    }
+    return ret;
+}
+
+// the biggest configs take a while to generate, CONFIGBENCH_MAX_KEYS allows to skip them
+int maxKeys()
+{
+    bool ok = false;
+    int ret = qEnvironmentVariableIntValue("CONFIGBENCH_MAX_KEYS", &ok);
+    return ok ? ret : 1000000;
+}
+
+}
+
+class SignalCounter : public QObject
+{
+    Q_OBJECT
+
+public:
+    int count = 0;
+
+public slots:
+    void hit() { ++count; }
+};
+
+class ConfigBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void rootLoad_data();
+    void rootLoad();
+    void rootLoadCached_data();
+    void rootLoadCached();
+    void layerLoad_data();
+    void layerLoad();
+    void activateDeactivate_data();
+    void activateDeactivate();
+    void applyLayerSet_data();
+    void applyLayerSet();
+    void changeLayerPriority_data();
+    void changeLayerPriority();
+    void getProperty_data();
+    void getProperty();
+    void setProperty_data();
+    void setProperty();
+    void writeConfig_data();
+    void writeConfig();
+    void metaPropertyRead_data();
+    void metaPropertyRead();
+    void qmlPropertyRead_data();
+    void qmlPropertyRead();
+    void changeSignals_data();
+    void changeSignals();
+
+private:
+    struct Fixture
+    {
+        QString rootPath;
+        QStringList layerPaths;
+        QStringList layerNames;
+        QStringList valueKeys;
+        QStringList integerKeys;
+    };
+
+    void addSizeRows();
+    void addLayerRows();
+    const Fixture &fixture(int keys, int depth, int layers);
+    std::unique_ptr<JsonConfig> load(const Fixture &f, int layers);
+    QVector<QPair<QObject*, QMetaProperty>> resolveProperties(JsonConfig *config, const QStringList &keys);
+
+    QTemporaryDir m_dir;
+    QMap<QString, Fixture> m_fixtures;
+};
+
+void ConfigBenchmark::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    qRegisterMetaType<BenchStyle*>();
+    // JsonConfig reports every layer activation and property write
+    QLoggingCategory::setFilterRules(QStringLiteral("default.debug=false"));
+}
+
+void ConfigBenchmark::addSizeRows()
+{
+    QTest::addColumn<int>("keys");
+    QTest::addColumn<int>("depth");
+    QTest::addColumn<int>("layers");
+    if (maxKeys() >= 1000) {
+        QTest::newRow("1k") << 1000 << 3 << 1;
+    }
+    if (maxKeys() >= 100000) {
+        QTest::newRow("100k") << 100000 << 4 << 1;
+    }
+    if (maxKeys() >= 1000000) {
+        QTest::newRow("1M") << 1000000 << 5 << 1;
+    }
+}
+
+void ConfigBenchmark::addLayerRows()
+{
+    QTest::addColumn<int>("keys");
+    QTest::addColumn<int>("depth");
+    QTest::addColumn<int>("layers");
+    if (maxKeys() >= 1000) {
+        QTest::newRow("1k x 1") << 1000 << 3 << 1;
+        QTest::newRow("1k x 50") << 1000 << 3 << 50;
+        QTest::newRow("1k x 500") << 1000 << 3 << 500;
+    }
+    if (maxKeys() >= 100000) {
+        QTest::newRow("100k x 10") << 100000 << 4 << 10;
+        QTest::newRow("100k x 100") << 100000 << 4 << 100;
+    }
+    if (maxKeys() >= 1000000) {
+        QTest::newRow("1M x 10") << 1000000 << 5 << 10;
+    }
+}
+
+// generates config files once per size, the layers of smaller layer counts are shared with the bigger ones
+const ConfigBenchmark::Fixture &ConfigBenchmark::fixture(int keys, int depth, int layers)
+{
+    QString id = QStringLiteral("%1-%2").arg(keys).arg(depth);
+    Fixture &f = m_fixtures[id];
+    if (!f.rootPath.isEmpty() && f.layerPaths.size() >= layers) {
+        return f;
+    }
+    ConfigGenerator::Options options;
+    options.keys = keys;
+    options.depth = depth;
+    ConfigGenerator generator(options);
+    if (f.rootPath.isEmpty()) {
+        QDir dir(m_dir.path());
+        dir.mkdir(id);
+        dir.cd(id);
+        f.rootPath = dir.filePath(QStringLiteral("root.json"));
+        ConfigGenerator::writeFile(f.rootPath, generator.root());
+        f.valueKeys = sample(generator.valueKeys());
+        f.integerKeys = sample(generator.keys(ConfigGenerator::Integer));
+    }
+    for (int i = f.layerPaths.size(); i < layers; ++i) {
+        QString path = QFileInfo(f.rootPath).dir().filePath(QStringLiteral("layer%1.json").arg(i));
+        ConfigGenerator::writeFile(path, generator.layer(i));
+        f.layerPaths.append(path);
+        f.layerNames.append(QStringLiteral("layer%1").arg(i));
+    }
+    return f;
+}
+
+std::unique_ptr<JsonConfig> ConfigBenchmark::load(const Fixture &f, int layers)
+{
+    auto config = std::make_unique<JsonConfig>();
+    config->setDeferUpdate(false);
+    config->setFilePath(f.rootPath);
+    if (layers > 0) {
+        config->loadLayers(f.layerPaths.mid(0, layers), f.layerNames.mid(0, layers), 1);
+    }
+    return config;
+}
+
+QVector<QPair<QObject*, QMetaProperty>> ConfigBenchmark::resolveProperties(JsonConfig *config, const QStringList &keys)
+{
+    QVector<QPair<QObject*, QMetaProperty>> ret;
+    for (const auto &key : keys) {
+        QStringList parts = key.split('.');
+        QObject *o = config->configData();
+        while (o && parts.size() > 1) {
+            o = o->property(parts.takeFirst().toUtf8().constData()).value<QObject*>();
+        }
+        if (!o) {
+            continue;
+        }
+        int idx = o->metaObject()->indexOfProperty(parts.first().toUtf8().constData());
+        if (idx != -1) {
+            ret.append({ o, o->metaObject()->property(idx) });
+        }
+    }
+    return ret;
+}
+
+void ConfigBenchmark::rootLoad_data()
+{
+    addSizeRows();
+}
+
+void ConfigBenchmark::rootLoad()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    const Fixture &f = fixture(keys, depth, 0);
+    QBENCHMARK {
+        JsonConfig config;
+        config.setDeferUpdate(false);
+        config.setFilePath(f.rootPath);
+    }
+}
+
+void ConfigBenchmark::rootLoadCached_data()
+{
+    addSizeRows();
+}
+
+void ConfigBenchmark::rootLoadCached()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    const Fixture &f = fixture(keys, depth, 0);
+    QString cacheDir = m_dir.filePath(QStringLiteral("cache"));
+    {
+        // fill the cache
+        JsonConfig config;
+        config.setCacheDir(cacheDir);
+        config.setFilePath(f.rootPath);
+    }
+    QBENCHMARK {
+        JsonConfig config;
+        config.setDeferUpdate(false);
+        config.setCacheDir(cacheDir);
+        config.setFilePath(f.rootPath);
+    }
+}
+
+void ConfigBenchmark::layerLoad_data()
+{
+    addLayerRows();
+}
+
+void ConfigBenchmark::layerLoad()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    QFETCH(int, layers);
+    const Fixture &f = fixture(keys, depth, layers);
+    auto config = load(f, 0);
+    QStringList paths = f.layerPaths.mid(0, layers);
+    QStringList names = f.layerNames.mid(0, layers);
+    QBENCHMARK {
+        config->loadLayers(paths, names, 1);
+        for (const auto &name : names) {
+            config->unloadLayer(name);
+        }
+    }
+}
+
+void ConfigBenchmark::activateDeactivate_data()
+{
+    addLayerRows();
+}
+
+void ConfigBenchmark::activateDeactivate()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    QFETCH(int, layers);
+    const Fixture &f = fixture(keys, depth, layers);
+    auto config = load(f, layers);
+    QStringList names = f.layerNames.mid(0, layers);
+    QBENCHMARK {
+        for (const auto &name : names) {
+            config->activateLayer(name);
+        }
+        for (const auto &name : names) {
+            config->deactivateLayer(name);
+        }
+    }
+}
+
+void ConfigBenchmark::applyLayerSet_data()
+{
+    addLayerRows();
+}
+
+void ConfigBenchmark::applyLayerSet()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    QFETCH(int, layers);
+    const Fixture &f = fixture(keys, depth, layers);
+    auto config = load(f, layers);
+    // switch between the even and the odd layers, as a theme switch does
+    QStringList even;
+    QStringList odd;
+    for (int i = 0; i < layers; ++i) {
+        (i % 2 ? odd : even).append(f.layerNames[i]);
+    }
+    QBENCHMARK {
+        config->applyLayerSet(even);
+        config->applyLayerSet(odd);
+    }
+}
+
+void ConfigBenchmark::changeLayerPriority_data()
+{
+    addLayerRows();
+}
+
+void ConfigBenchmark::changeLayerPriority()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    QFETCH(int, layers);
+    const Fixture &f = fixture(keys, depth, layers);
+    auto config = load(f, layers);
+    config->applyLayerSet(f.layerNames.mid(0, layers));
+    const QString &name = f.layerNames.first();
+    QBENCHMARK {
+        config->changeLayerPriority(name, layers + 1);
+        config->changeLayerPriority(name, 1);
+    }
+}
+
+void ConfigBenchmark::getProperty_data()
+{
+    addSizeRows();
+}
+
+void ConfigBenchmark::getProperty()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    const Fixture &f = fixture(keys, depth, 0);
+    auto config = load(f, 0);
+    QVERIFY(config->getProperty(QString(), f.valueKeys.first()).isValid());
+    QBENCHMARK {
+        for (const auto &key : f.valueKeys) {
+            config->getProperty(QString(), key);
+        }
+    }
+}
+
+void ConfigBenchmark::setProperty_data()
+{
+    addSizeRows();
+}
+
+void ConfigBenchmark::setProperty()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    QFETCH(int, layers);
+    const Fixture &f = fixture(keys, depth, layers);
+    auto config = load(f, layers);
+    const QString &layer = f.layerNames.first();
+    config->activateLayer(layer);
+    int round = 0;
+    QBENCHMARK {
+        ++round;
+        for (const auto &key : f.integerKeys) {
+            config->setProperty(layer, key, round);
+        }
+    }
+}
+
+void ConfigBenchmark::writeConfig_data()
+{
+    addSizeRows();
+}
+
+void ConfigBenchmark::writeConfig()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    const Fixture &f = fixture(keys, depth, 0);
+    auto config = load(f, 0);
+    QString path = m_dir.filePath(QStringLiteral("written.json"));
+    QBENCHMARK {
+        config->writeConfig(path, QStringLiteral("root"));
+    }
+    QVERIFY(QFileInfo(path).size() > 0);
+}
+
+void ConfigBenchmark::metaPropertyRead_data()
+{
+    addSizeRows();
+}
+
+void ConfigBenchmark::metaPropertyRead()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    const Fixture &f = fixture(keys, depth, 0);
+    auto config = load(f, 0);
+    auto properties = resolveProperties(config.get(), f.valueKeys);
+    QCOMPARE(properties.size(), f.valueKeys.size());
+    QBENCHMARK {
+        for (const auto &p : properties) {
+            p.second.read(p.first);
+        }
+    }
+}
+
+void ConfigBenchmark::qmlPropertyRead_data()
+{
+    addSizeRows();
+}
+
+void ConfigBenchmark::qmlPropertyRead()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    const Fixture &f = fixture(keys, depth, 0);
+    auto config = load(f, 0);
+    QQmlEngine engine;
+    QQmlComponent component(&engine);
+    component.setData(R"(
+        import QtQml 2.0
+        QtObject {
+            property var config
+            function readAll(paths) {
+                var n = 0
+                for (var i = 0; i < paths.length; ++i) {
+                    var o = config
+                    var p = paths[i]
+                    for (var j = 0; j < p.length; ++j) {
+                        o = o[p[j]]
+                    }
+                    if (o !== undefined) {
+                        ++n
+                    }
+                }
+                return n
+            }
+        })", QUrl());
+    std::unique_ptr<QObject> reader(component.create());
+    QVERIFY2(reader, qPrintable(component.errorString()));
+    reader->setProperty("config", QVariant::fromValue(config->configData()));
+    QVariantList paths;
+    for (const auto &key : f.valueKeys) {
+        paths.append(key.split('.'));
+    }
+    QVariant read;
+    QMetaObject::invokeMethod(reader.get(), "readAll", Q_RETURN_ARG(QVariant, read), Q_ARG(QVariant, paths));
+    QCOMPARE(read.toInt(), paths.size());
+    QBENCHMARK {
+        QMetaObject::invokeMethod(reader.get(), "readAll", Q_RETURN_ARG(QVariant, read), Q_ARG(QVariant, paths));
+    }
+}
+
+void ConfigBenchmark::changeSignals_data()
+{
+    addSizeRows();
+}
+
+// writes properties of the generated objects with a listener connected to each of them, so every write
+// goes through the whole change notification path
+void ConfigBenchmark::changeSignals()
+{
+    QFETCH(int, keys);
+    QFETCH(int, depth);
+    const Fixture &f = fixture(keys, depth, 0);
+    auto config = load(f, 0);
+    auto properties = resolveProperties(config.get(), f.integerKeys);
+    SignalCounter counter;
+    QMetaMethod hit = counter.metaObject()->method(counter.metaObject()->indexOfSlot("hit()"));
+    for (const auto &p : properties) {
+        QObject::connect(p.first, p.second.notifySignal(), &counter, hit);
+    }
+    qlonglong round = 0;
+    QBENCHMARK {
+        ++round;
+        for (const auto &p : properties) {
+            p.second.write(p.first, round);
+        }
+    }
+    QVERIFY(counter.count > 0);
+}
+
+namespace {
+
+// QtTest has no JSON output, so the results are collected from its XML log and written as a JSON document
+// which can be stored and compared between releases
+bool writeJsonReport(const QString &xmlPath, const QString &jsonPath)
+{
+    QFile xml(xmlPath);
+    if (!xml.open(QIODevice::ReadOnly)) {
+        qWarning().noquote() << "Failed to read benchmark log" << xmlPath << xml.errorString();
+        return false;
+    }
+    QJsonArray results;
+    QString function;
+    QXmlStreamReader r(&xml);
+    while (!r.atEnd()) {
+        if (r.readNext() != QXmlStreamReader::StartElement) {
+            continue;
+        }
+        if (r.name() == QLatin1String("TestFunction")) {
+            function = r.attributes().value(QLatin1String("name")).toString();
+        } else if (r.name() == QLatin1String("BenchmarkResult")) {
+            const auto a = r.attributes();
+            double value = a.value(QLatin1String("value")).toDouble();
+            int iterations = a.value(QLatin1String("iterations")).toInt();
+            results.append(QJsonObject {
+                               { "function", function },
+                               { "tag", a.value(QLatin1String("tag")).toString() },
+                               { "metric", a.value(QLatin1String("metric")).toString() },
+                               { "value", value },
+                               { "iterations", iterations } });
+        }
+    }
+    if (r.hasError()) {
+        qWarning().noquote() << "Failed to parse benchmark log" << xmlPath << r.errorString();
+        return false;
+    }
+    QJsonObject report {
+        { "suite", QStringLiteral("ConfigBenchmark") },
+        { "qtVersion", QString::fromLatin1(qVersion()) },
+        { "platform", QSysInfo::prettyProductName() },
+        { "cpu", QSysInfo::currentCpuArchitecture() },
+        { "timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate) },
+        { "results", results }
+    };
+    QFile f(jsonPath);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning().noquote() << "Failed to open file" << jsonPath << "for writing:" << f.errorString();
+        return false;
+    }
+    f.write(QJsonDocument(report).toJson(QJsonDocument::Indented));
+    return true;
+}
+
+}
+
+// Accepts the usual QtTest arguments, plus -json <file> to write the results as JSON
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    QString jsonPath;
+    int jsonArg = args.indexOf(QStringLiteral("-json"));
+    if (jsonArg != -1 && jsonArg + 1 < args.size()) {
+        jsonPath = args[jsonArg + 1];
+        args.removeAt(jsonArg);
+        args.removeAt(jsonArg);
+    }
+    QTemporaryDir logDir;
+    QString xmlPath = logDir.filePath(QStringLiteral("results.xml"));
+    if (!jsonPath.isEmpty()) {
+        if (!args.contains(QStringLiteral("-o"))) {
+            args << QStringLiteral("-o") << QStringLiteral("-,txt");
+        }
+        args << QStringLiteral("-o") << xmlPath + QStringLiteral(",xml");
+    }
+    ConfigBenchmark bench;
+    int ret = QTest::qExec(&bench, args);
+    if (!jsonPath.isEmpty() && !writeJsonReport(xmlPath, jsonPath)) {
+        return ret ? ret : 1;
+    }
+    return ret;
+}
+
+#include "tst_configbenchmark.moc"
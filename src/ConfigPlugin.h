@@ -5,6 +5,8 @@
 
 #include "jsonconfig.h"
 #include "configlayer.h"
+#include "confighandle.h"
+#include "configstats.h"
 
 
 class ConfigPlugin : public QQmlExtensionPlugin
@@ -16,5 +18,7 @@ class ConfigPlugin : public QQmlExtensionPlugin
     {
         qmlRegisterType<JsonConfig>(uri, 1, 0, "JsonConfig");
         qmlRegisterType<ConfigLayer>(uri, 1, 0, "ConfigLayer");
+        qmlRegisterUncreatableType<ConfigHandle>(uri, 1, 0, "ConfigHandle", "ConfigHandle is created by JsonConfig.handle()");
+        qmlRegisterUncreatableType<ConfigStats>(uri, 1, 0, "ConfigStats", "ConfigStats is provided by JsonConfig.stats");
     }
 };
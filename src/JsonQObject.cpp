@@ -2,6 +2,60 @@
 
 #include <QtCore/QMetaProperty>
 
+#include "private/metaobjectcache.h"
+
+namespace {
+
+// converts a number of another type (e.g. 2 overriding 1.5, or an int set from QML) into the property storage.
+// Other mismatching values leave the default value
+void readConverted(const Node::NamedMultiValue &p, const QVariant &v, void *a)
+{
+    auto valueKind = Node::NamedMultiValue::kindOf(v);
+    if (valueKind != Node::NamedMultiValue::Double && valueKind != Node::NamedMultiValue::Integer) {
+        return;
+    }
+    if (p.kind == Node::NamedMultiValue::Double) {
+        *static_cast<double*>(a) = v.toDouble();
+    } else if (p.kind == Node::NamedMultiValue::Integer) {
+        *static_cast<qlonglong*>(a) = v.toLongLong();
+    }
+}
+
+// copies the effective value into the property storage passed by the caller. A value of the property type
+// is copied directly, without going through the metatype system
+void readValue(const Node::NamedMultiValue &p, void *a)
+{
+    const QVariant &v = p.value();
+    if (p.kind == Node::NamedMultiValue::Other) {
+        return;
+    }
+    if (v.userType() != Node::NamedMultiValue::storageType(p.kind)) {
+        readConverted(p, v, a);
+        return;
+    }
+    switch (p.kind) {
+    case Node::NamedMultiValue::Bool:
+        *static_cast<bool*>(a) = *static_cast<const bool*>(v.constData());
+        break;
+    case Node::NamedMultiValue::Double:
+        *static_cast<double*>(a) = *static_cast<const double*>(v.constData());
+        break;
+    case Node::NamedMultiValue::Integer:
+        *static_cast<qlonglong*>(a) = *static_cast<const qlonglong*>(v.constData());
+        break;
+    case Node::NamedMultiValue::String:
+        *static_cast<QString*>(a) = *static_cast<const QString*>(v.constData());
+        break;
+    case Node::NamedMultiValue::List:
+        *static_cast<QVariantList*>(a) = *static_cast<const QVariantList*>(v.constData());
+        break;
+    case Node::NamedMultiValue::Other:
+        break;
+    }
+}
+
+}
+
 JsonQObject::JsonQObject(QObject *parent)
     : QObject(parent)
 {
@@ -18,8 +72,8 @@ JsonQObject::JsonQObject(QMetaObject *mo, Node *node, QObject *parent)
 
 JsonQObject::~JsonQObject()
 {
-    // metaobject is unique for each JsonQObject and is created using malloc/memset by QMetaObjectBuilder, hence NOLINT
-    free(m_metaObject); // NOLINT
+    // metaobject is shared between objects of the same shape and owned by the cache
+    MetaObjectCache::instance().release(m_metaObject);
 }
 
 int JsonQObject::qt_metacall(QMetaObject::Call call, int id, void **arguments)
@@ -89,35 +143,7 @@ void JsonQObject::metacallImpl(QMetaObject::Call call, int id, void **arguments)
         void *a = arguments[0]; // NOLINT
 
         if (isPod) {
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-            int ptype = m_metaObject->property(id).userType();
-            const QVariant &prop = m_node->valueAt(index);//properties[index].second;
-            if (ptype != prop.userType()) {
-                if (ptype == qMetaTypeId<qlonglong>()) {
-                    qlonglong val = prop.toLongLong();
-                    QMetaType::construct(ptype, arguments[0], &val); // NOLINT
-                } else if (ptype == qMetaTypeId<double>()) {
-                    double val = prop.toDouble();
-                    QMetaType::construct(ptype, arguments[0], &val); // NOLINT
-                }
-            } else {
-                QMetaType::construct(ptype, arguments[0], prop.constData()); // NOLINT
-            }
-#else
-            QMetaType ptype = m_metaObject->property(id).metaType();
-            const QVariant &prop = m_node->valueAt(index);
-            if (ptype != prop.metaType()) {
-                if (ptype == QMetaType::fromType<qlonglong>()) {
-                    qlonglong val = prop.toLongLong();
-                    ptype.construct(arguments[0], &val);
-                } else if (ptype == QMetaType::fromType<double>()) {
-                    double val = prop.toDouble();
-                    ptype.construct(arguments[0], &val);
-                }
-            } else {
-                ptype.construct(arguments[0], prop.constData());
-            }
-#endif
+            readValue(m_node->properties.at(index), a);
         } else {
             *reinterpret_cast<QObject**>(a) = m_node->childAt(index)->object(); // NOLINT
         }
@@ -137,7 +163,7 @@ void JsonQObject::metacallImpl(QMetaObject::Call call, int id, void **arguments)
         qDebug() << "Write property" << index << "val" << value;
         if (m_node->properties.size() > index) {
             m_node->properties[index].setValue(value);
-            m_node->notifyPropertyUpdate(index);
+            m_node->propertyChangedHelper(index);
         }
         break;
     }
@@ -0,0 +1,88 @@
+#include "confighandle.h"
+#include "jsonconfig.h"
+
+ConfigHandle::ConfigHandle(JsonConfig *config, QString key, QObject *parent)
+    : QObject{parent},
+      m_config(config),
+      m_key(std::move(key))
+{
+    connect(config, &JsonConfig::configDataChanged, this, &ConfigHandle::onConfigDataChanged);
+    resolve();
+}
+
+const QString &ConfigHandle::key() const
+{
+    return m_key;
+}
+
+bool ConfigHandle::isValid()
+{
+    return resolve();
+}
+
+// returns the effective value, i. e. the value from the topmost active layer
+QVariant ConfigHandle::value()
+{
+    if (!resolve()) {
+        return {};
+    }
+    return m_node->valueAt(m_propertyIndex);
+}
+
+QVariant ConfigHandle::get(const QString &layer)
+{
+    if (!resolve()) {
+        return {};
+    }
+    return m_config->doGetProperty(m_node, m_propertyIndex, layer);
+}
+
+void ConfigHandle::set(const QString &layer, const QVariant &value)
+{
+    if (!resolve()) {
+        return;
+    }
+    m_config->doSetProperty(m_node, m_propertyIndex, layer, value);
+}
+
+void ConfigHandle::reset(const QString &layer)
+{
+    if (!resolve()) {
+        return;
+    }
+    m_config->doResetProperty(m_node, m_propertyIndex, layer);
+}
+
+const Node::NamedMultiValue *ConfigHandle::property()
+{
+    if (!resolve()) {
+        return nullptr;
+    }
+    return &m_node->properties.at(m_propertyIndex);
+}
+
+bool ConfigHandle::resolve()
+{
+    if (!m_config) {
+        return false;
+    }
+    if (m_generation != m_config->m_treeGeneration) {
+        m_node = m_config->m_root.getNode(m_key, &m_propertyIndex);
+        m_generation = m_config->m_treeGeneration;
+        bool valid = m_node && m_propertyIndex != -1;
+        // nothing can be resolved while the tree is cleared
+        if (!valid && m_config->m_root.isLoaded()) {
+            qWarning() << "Property" << m_key << "does not exist in base config";
+        }
+        if (valid != m_valid) {
+            m_valid = valid;
+            emit validChanged();
+        }
+    }
+    return m_valid;
+}
+
+void ConfigHandle::onConfigDataChanged()
+{
+    resolve();
+}
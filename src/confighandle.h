@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QVariant>
+
+#include "private/node.h"
+
+class JsonConfig;
+
+// Handle to a config property resolved from its key path once. Stays valid while layers are
+// loaded, activated or deactivated, and is resolved again if the root config is reloaded.
+class ConfigHandle : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QString key READ key CONSTANT)
+    Q_PROPERTY(bool valid READ isValid NOTIFY validChanged)
+
+public:
+    ConfigHandle(JsonConfig *config, QString key, QObject *parent = nullptr);
+
+    const QString &key() const;
+    bool isValid();
+
+    Q_INVOKABLE QVariant value();
+    Q_INVOKABLE QVariant get(const QString &layer = QString());
+    Q_INVOKABLE void set(const QString &layer, const QVariant &value);
+    Q_INVOKABLE void reset(const QString &layer);
+
+    // resolved property, or nullptr if the key doesn't exist in the config
+    const Node::NamedMultiValue *property();
+
+signals:
+    void validChanged();
+
+private slots:
+    // resolves the key again right away when the tree is rebuilt, so bindings on valid are updated
+    void onConfigDataChanged();
+
+private:
+    bool resolve();
+
+    QPointer<JsonConfig> m_config;
+    QString m_key;
+    Node *m_node = nullptr;
+    int m_propertyIndex = -1;
+    quint64 m_generation = 0;
+    bool m_valid = false;
+};
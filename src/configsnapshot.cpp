@@ -0,0 +1,46 @@
+#include "configsnapshot.h"
+
+ConfigSnapshot::ConfigSnapshot(std::shared_ptr<const Entry> root, quint64 version)
+    : m_root(std::move(root)),
+      m_version(version)
+{
+}
+
+quint64 ConfigSnapshot::version() const
+{
+    return m_version;
+}
+
+QVariant ConfigSnapshot::value(const QString &key, const QVariant &defaultValue) const
+{
+    const QVariant *v = find(key);
+    return v ? *v : defaultValue;
+}
+
+bool ConfigSnapshot::contains(const QString &key) const
+{
+    return find(key) != nullptr;
+}
+
+const ConfigSnapshot::Entry *ConfigSnapshot::root() const
+{
+    return m_root.get();
+}
+
+// the path segments are looked up through raw data views of the key, so a lookup doesn't copy the key
+const QVariant *ConfigSnapshot::find(const QString &key) const
+{
+    const Entry *e = m_root.get();
+    int start = 0;
+    while (e) {
+        int dot = key.indexOf(QLatin1Char('.'), start);
+        if (dot == -1) {
+            auto it = e->values.constFind(QString::fromRawData(key.constData() + start, key.size() - start));
+            return it == e->values.constEnd() ? nullptr : &it.value();
+        }
+        auto it = e->children.constFind(QString::fromRawData(key.constData() + start, dot - start));
+        e = it == e->children.constEnd() ? nullptr : it->get();
+        start = dot + 1;
+    }
+    return nullptr;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QVariant>
+
+#include <memory>
+
+// Immutable copy of the effective config values at one point in time, published by JsonConfig after each update.
+// Snapshots are never modified once published, so any thread can read them without locking. Subtrees without
+// changes are shared between consecutive snapshots.
+class ConfigSnapshot
+{
+public:
+    // values and child sections of one node
+    struct Entry
+    {
+        QHash<QString, QVariant> values;
+        QHash<QString, std::shared_ptr<const Entry>> children;
+    };
+
+    ConfigSnapshot(std::shared_ptr<const Entry> root, quint64 version);
+
+    // incremented with every published snapshot, compare with JsonConfig::snapshotVersion() to detect a stale one
+    quint64 version() const;
+
+    // effective value of the property with the given key path, e.g. "colors.button.background"
+    QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
+    bool contains(const QString &key) const;
+    const Entry *root() const;
+
+private:
+    const QVariant *find(const QString &key) const;
+
+    std::shared_ptr<const Entry> m_root;
+    quint64 m_version;
+};
+
+using ConfigSnapshotPtr = std::shared_ptr<const ConfigSnapshot>;
@@ -0,0 +1,244 @@
+#include "configstats.h"
+#include "private/stringpool.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+
+// upper bounds of the latency histogram buckets in microseconds, the last bucket takes everything above
+constexpr qint64 latencyBuckets[] = { 100, 250, 500, 1000, 2000, 4000, 8000, 16000, 33000, 66000, 133000 };
+
+qreal toMsecs(qint64 nsecs)
+{
+    return qreal(nsecs) / 1000000;
+}
+
+}
+
+ConfigStats::ConfigStats(QObject *parent)
+    : QObject{parent},
+      m_epoch(now())
+{
+    static_assert(sizeof(latencyBuckets) / sizeof(latencyBuckets[0]) + 1 == LatencyBucketCount, "Latency bucket count mismatch");
+}
+
+void ConfigStats::setEnabled(bool newEnabled)
+{
+    if (m_enabled == newEnabled) {
+        return;
+    }
+    m_enabled = newEnabled;
+    m_switchStart = 0;
+    emit enabledChanged();
+}
+
+void ConfigStats::setTracing(bool newTracing)
+{
+    if (m_tracing == newTracing) {
+        return;
+    }
+    m_tracing = newTracing;
+    emit tracingChanged();
+}
+
+QVariantList ConfigStats::layers() const
+{
+    QVariantList ret;
+    for (auto it = m_layers.begin(); it != m_layers.end(); ++it) {
+        ret.append(QVariantMap {
+                       { "name", it.key() },
+                       { "read", toMsecs(it->read) },
+                       { "parse", toMsecs(it->parse) },
+                       { "apply", toMsecs(it->apply) },
+                       { "applied", it->applied } });
+    }
+    return ret;
+}
+
+int ConfigStats::propertyWrites() const
+{
+    return m_propertyWrites;
+}
+
+int ConfigStats::signalsEmitted() const
+{
+    return m_signalsEmitted;
+}
+
+int ConfigStats::refsResolved() const
+{
+    return m_refsResolved;
+}
+
+int ConfigStats::metaObjectsBuilt() const
+{
+    return m_metaObjectsBuilt;
+}
+
+QVariantList ConfigStats::latencyHistogram() const
+{
+    QVariantList ret;
+    for (int i = 0; i < LatencyBucketCount; ++i) {
+        qreal upTo = i < LatencyBucketCount - 1 ? qreal(latencyBuckets[i]) / 1000 : 0;
+        ret.append(QVariantMap { { "upTo", upTo }, { "count", m_latencies[size_t(i)] } });
+    }
+    return ret;
+}
+
+qreal ConfigStats::lastLatency() const
+{
+    return toMsecs(m_lastLatency);
+}
+
+QVariantMap ConfigStats::strings() const
+{
+    if (!m_stringPool) {
+        return {};
+    }
+    return QVariantMap {
+        { "count", m_stringPool->size() },
+        { "bytes", m_stringPool->bytes() },
+        { "hits", m_stringPool->hits() },
+        { "savedBytes", m_stringPool->savedBytes() } };
+}
+
+void ConfigStats::setStringPool(const StringPool *pool)
+{
+    m_stringPool = pool;
+}
+
+void ConfigStats::reset()
+{
+    m_propertyWrites = 0;
+    m_signalsEmitted = 0;
+    m_refsResolved = 0;
+    m_metaObjectsBuilt = 0;
+    m_layers.clear();
+    m_latencies.fill(0);
+    m_lastLatency = 0;
+    m_switchStart = 0;
+    m_trace.clear();
+    emit updated();
+}
+
+bool ConfigStats::writeTrace(const QString &path) const
+{
+    QJsonArray events;
+    qint64 pid = QCoreApplication::applicationPid();
+    auto threadName = [&](int tid, const QString &name) {
+        events.append(QJsonObject {
+                          { "name", "thread_name" },
+                          { "ph", "M" },
+                          { "pid", pid },
+                          { "tid", tid },
+                          { "args", QJsonObject { { "name", name } } } });
+    };
+    threadName(GuiThread, QStringLiteral("GUI"));
+    threadName(LoaderThread, QStringLiteral("Layer loader"));
+    for (const auto &e : m_trace) {
+        QJsonObject event {
+            { "name", QLatin1String(e.name) },
+            { "cat", "config" },
+            { "ph", "X" },
+            { "ts", qreal(e.start - m_epoch) / 1000 },
+            { "dur", qreal(e.duration) / 1000 },
+            { "pid", pid },
+            { "tid", e.thread } };
+        if (!e.argument.isEmpty()) {
+            event.insert("args", QJsonObject { { "layer", e.argument } });
+        }
+        events.append(event);
+    }
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning().noquote() << "Failed to open file" << path << "for writing:" << f.errorString();
+        return false;
+    }
+    f.write(QJsonDocument(QJsonObject { { "traceEvents", events }, { "displayTimeUnit", "ms" } }).toJson(QJsonDocument::Compact));
+    return true;
+}
+
+void ConfigStats::addSpan(const char *name, qint64 start, const QString &argument)
+{
+    if (!m_enabled || !m_tracing || start == 0) {
+        return;
+    }
+    addTraceEvent(name, start, now() - start, GuiThread, argument);
+}
+
+// read and parse times are measured on the loader threads and reported once the layer is inserted
+void ConfigStats::layerLoaded(const QString &name, qint64 loadStart, qint64 readTime, qint64 parseTime)
+{
+    if (!m_enabled) {
+        return;
+    }
+    auto &l = m_layers[name];
+    l.read += readTime;
+    l.parse += parseTime;
+    if (m_tracing && loadStart != 0) {
+        addTraceEvent("read", loadStart, readTime, LoaderThread, name);
+        if (parseTime > 0) {
+            addTraceEvent("parse", loadStart + readTime, parseTime, LoaderThread, name);
+        }
+    }
+}
+
+void ConfigStats::layerApplied(const QString &name, qint64 start)
+{
+    if (!m_enabled || start == 0) {
+        return;
+    }
+    qint64 duration = now() - start;
+    auto &l = m_layers[name];
+    l.apply += duration;
+    ++l.applied;
+    if (m_tracing) {
+        addTraceEvent("apply", start, duration, GuiThread, name);
+    }
+}
+
+// a layer switch was requested, its latency is measured until the signals of the update applying it are emitted
+void ConfigStats::switchStarted()
+{
+    if (m_enabled && m_switchStart == 0) {
+        m_switchStart = now();
+    }
+}
+
+void ConfigStats::switchFinished()
+{
+    if (!m_enabled || m_switchStart == 0) {
+        return;
+    }
+    m_lastLatency = now() - m_switchStart;
+    qint64 us = m_lastLatency / 1000;
+    size_t bucket = 0;
+    while (bucket < m_latencies.size() - 1 && us >= latencyBuckets[bucket]) {
+        ++bucket;
+    }
+    ++m_latencies[bucket];
+    if (m_tracing) {
+        addTraceEvent("layer switch", m_switchStart, m_lastLatency, GuiThread, QString());
+    }
+    m_switchStart = 0;
+}
+
+void ConfigStats::publish()
+{
+    if (m_enabled) {
+        emit updated();
+    }
+}
+
+void ConfigStats::addTraceEvent(const char *name, qint64 start, qint64 duration, int thread, const QString &argument)
+{
+    if (m_trace.size() >= MaxTraceEvents) {
+        return;
+    }
+    m_trace.append({ name, argument, start, duration, thread });
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QVariant>
+#include <QVector>
+
+#include <array>
+#include <chrono>
+
+class StringPool;
+
+// Performance counters of a JsonConfig: layer read, parse and apply times, property writes, change signals,
+// resolved refs and built metaobjects, and the latency from a layer switch to its last change signal.
+// While tracing, spans are also recorded and can be exported as Chrome trace events. Nothing is recorded while
+// disabled, the counting functions only check a flag then.
+class ConfigStats : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool enabled READ isEnabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(bool tracing READ isTracing WRITE setTracing NOTIFY tracingChanged)
+    Q_PROPERTY(QVariantList layers READ layers NOTIFY updated)
+    Q_PROPERTY(int propertyWrites READ propertyWrites NOTIFY updated)
+    Q_PROPERTY(int signalsEmitted READ signalsEmitted NOTIFY updated)
+    Q_PROPERTY(int refsResolved READ refsResolved NOTIFY updated)
+    Q_PROPERTY(int metaObjectsBuilt READ metaObjectsBuilt NOTIFY updated)
+    Q_PROPERTY(QVariantList latencyHistogram READ latencyHistogram NOTIFY updated)
+    Q_PROPERTY(qreal lastLatency READ lastLatency NOTIFY updated)
+    Q_PROPERTY(QVariantMap strings READ strings NOTIFY updated)
+
+public:
+    explicit ConfigStats(QObject *parent = nullptr);
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool newEnabled);
+    bool isTracing() const { return m_tracing; }
+    void setTracing(bool newTracing);
+
+    // per-layer times in milliseconds: name, read, parse, apply and the number of times the layer was applied
+    QVariantList layers() const;
+    int propertyWrites() const;
+    int signalsEmitted() const;
+    int refsResolved() const;
+    int metaObjectsBuilt() const;
+    // switch latencies: a list of { upTo: <bucket bound in ms, 0 for the last one>, count: <count> }
+    QVariantList latencyHistogram() const;
+    qreal lastLatency() const;
+    // interned strings: { count, bytes, hits, savedBytes }, see StringPool. Counted even while disabled
+    QVariantMap strings() const;
+    void setStringPool(const StringPool *pool);
+
+    Q_INVOKABLE void reset();
+    // writes the recorded spans in Chrome trace event format, which can be opened in Perfetto or chrome://tracing
+    Q_INVOKABLE bool writeTrace(const QString &path) const;
+
+    // monotonic time in nanoseconds, usable from any thread
+    static qint64 now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void countPropertyWrite()
+    {
+        if (m_enabled) {
+            ++m_propertyWrites;
+        }
+    }
+    void countSignal()
+    {
+        if (m_enabled) {
+            ++m_signalsEmitted;
+        }
+    }
+    void countRefs(int count = 1)
+    {
+        if (m_enabled) {
+            m_refsResolved += count;
+        }
+    }
+    void countMetaObject()
+    {
+        if (m_enabled) {
+            ++m_metaObjectsBuilt;
+        }
+    }
+
+    // start time for a span, 0 while disabled
+    qint64 spanStart() const
+    {
+        return m_enabled ? now() : 0;
+    }
+    void addSpan(const char *name, qint64 start, const QString &argument = QString());
+
+    void layerLoaded(const QString &name, qint64 loadStart, qint64 readTime, qint64 parseTime);
+    void layerApplied(const QString &name, qint64 start);
+    void switchStarted();
+    void switchFinished();
+    // notifies about the counters recorded so far. Called once per update rather than per counted event
+    void publish();
+
+signals:
+    void enabledChanged();
+    void tracingChanged();
+    void updated();
+
+private:
+    struct LayerTimes
+    {
+        qint64 read = 0;
+        qint64 parse = 0;
+        qint64 apply = 0;
+        int applied = 0;
+    };
+
+    struct TraceEvent
+    {
+        const char *name;
+        QString argument;
+        qint64 start;
+        qint64 duration;
+        int thread;
+    };
+
+    // thread ids of the trace, spans of the loader pool are shown on a separate track
+    enum { GuiThread = 1, LoaderThread = 2 };
+    static constexpr int MaxTraceEvents = 1000000;
+    static constexpr int LatencyBucketCount = 12;
+
+    void addTraceEvent(const char *name, qint64 start, qint64 duration, int thread, const QString &argument);
+
+    bool m_enabled = false;
+    bool m_tracing = false;
+    int m_propertyWrites = 0;
+    int m_signalsEmitted = 0;
+    int m_refsResolved = 0;
+    int m_metaObjectsBuilt = 0;
+    QHash<QString, LayerTimes> m_layers;
+    std::array<int, LatencyBucketCount> m_latencies {};
+    qint64 m_lastLatency = 0;
+    qint64 m_switchStart = 0;
+    qint64 m_epoch;
+    QVector<TraceEvent> m_trace;
+    const StringPool *m_stringPool = nullptr;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QPointer>
+
+#include "confighandle.h"
+#include "jsonconfig.h"
+
+// Typed accessor of a config property for C++ code. The converted value is cached and converted again
+// only when the property generation changes, so reading an unchanged value costs a couple of compares.
+//
+//     ConfigValue<double> fontSize(config, "editor.fontSize");
+//     painter.setFont(QFont(family, fontSize.get()));
+template<typename T>
+class ConfigValue
+{
+public:
+    ConfigValue(JsonConfig *config, const QString &key)
+        : m_handle(config->handle(key))
+    {
+    }
+
+    const T &get()
+    {
+        const Node::NamedMultiValue *p = m_handle ? m_handle->property() : nullptr;
+        if (p != m_property || (p && p->generation != m_generation)) {
+            m_property = p;
+            m_generation = p ? p->generation : 0;
+            m_value = p ? p->value().template value<T>() : T();
+        }
+        return m_value;
+    }
+
+    operator const T &() { return get(); } // NOLINT
+
+    bool isValid() { return m_handle && m_handle->property(); }
+    QString key() const { return m_handle ? m_handle->key() : QString(); }
+
+private:
+    QPointer<ConfigHandle> m_handle;
+    const Node::NamedMultiValue *m_property = nullptr;
+    quint64 m_generation = 0;
+    T m_value {};
+};
@@ -1,13 +1,18 @@
 #include "jsonconfig.h"
 #include "JsonQObject.h"
 #include "configlayer.h"
+#include "confighandle.h"
+#include "private/jsonreader.h"
 
 #include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QEvent>
 #include <QFile>
-#include <QJsonDocument>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
 #include <QMetaObject>
 #include <QMetaProperty>
+#include <QtConcurrent/QtConcurrentRun>
 
 const int JsonConfig::listenerSlotIndex = JsonConfig::staticMetaObject.indexOfSlot("onUserObjectPropertyChanged()");
 
@@ -27,44 +32,20 @@ QString getNameFromPath(const QString &path)
     return {};
 }
 
-QByteArray readFile(const QString &path, bool *ok)
+QString localPath(const QString &path)
 {
-    QFile f(path);
-
-    if (!f.open(QIODevice::ReadOnly)) {
-        QString msg = QString("File %1 not found").arg(path);
-        qWarning().noquote() << msg;
-        if (ok) {
-            *ok = false;
-        }
-        return QByteArray();
-    }
-    QByteArray data = f.readAll();
-    f.close();
-    if (ok) {
-        *ok = true;
+    if (path.startsWith("file:///")) {
+        return QUrl(path).toLocalFile();
     }
-    return data;
+    return path;
 }
 
-QJsonObject parseData(const QByteArray &data, bool *ok)
+QJsonObject subObject(QJsonObject object, const QStringList &path)
 {
-    QJsonParseError err;
-    QJsonDocument json = QJsonDocument::fromJson(data, &err);
-    if (err.error != QJsonParseError::NoError) {
-        QString msg = QString("Parse error: %1").arg(err.errorString());
-        qWarning().noquote() << msg;
-        *ok = false;
-        return {};
-    }
-    if (!json.isObject()) {
-        QString msg = QString("JSON must contain an object");
-        qWarning().noquote() << msg;
-        *ok = false;
-        return {}; // TODO: set invalid state
+    for (const auto &key : path) {
+        object = object.value(key).toObject();
     }
-    *ok = true;
-    return json.object();
+    return object;
 }
 
 }
@@ -73,6 +54,18 @@ JsonConfig::JsonConfig(QObject *parent)
     : QObject{parent}
 {
     m_root.setConfig(this);
+    m_refGraph.setRoot(&m_root);
+    m_stats = new ConfigStats(this);
+    m_refGraph.setStats(m_stats);
+    m_stats->setStringPool(&m_strings);
+    // one writer, so that writes of the same file are done in the order they were requested
+    m_writerPool.setMaxThreadCount(1);
+    m_reloadTimer.setSingleShot(true);
+    m_reloadTimer.setInterval(300);
+    connect(&m_reloadTimer, &QTimer::timeout, this, &JsonConfig::reloadChangedFiles);
+    m_journalSyncTimer.setSingleShot(true);
+    m_journalSyncTimer.setInterval(100);
+    connect(&m_journalSyncTimer, &QTimer::timeout, this, &JsonConfig::syncJournals);
 }
 
 const QString &JsonConfig::filePath() const
@@ -117,6 +110,14 @@ JsonConfig::Status JsonConfig::status() const
     return m_status;
 }
 
+qreal JsonConfig::loadingProgress() const
+{
+    if (m_loadsStarted == 0) {
+        return 1.0;
+    }
+    return qreal(m_loadsFinished) / m_loadsStarted;
+}
+
 void JsonConfig::userObjectCreated(Node *node, QObject *object)
 {
     m_userObjects.insert(object, node);
@@ -138,7 +139,7 @@ void JsonConfig::onUserObjectPropertyChanged()
             if (mp.notifySignalIndex() == idx) {
                 prop_idx = it.value()->indexOfProperty(mp.name());
                 if (prop_idx != -1) {
-                    it.value()->properties[prop_idx].setValue(mp.read(s));
+                    it.value()->setUserObjectValue(prop_idx, mp.read(s));
                 }
                 break;
             }
@@ -154,28 +155,94 @@ QString JsonConfig::loadLayer(const QString &path, QString name, int desiredInde
     return it ? it->name : "";
 }
 
+// loads config on the loader thread pool. The layer is added once it's parsed, which is reported by
+// layerLoaded or layerLoadFailed signals. Returns the name the layer will be registered with
+QString JsonConfig::loadLayerAsync(const QString &path, QString name, int desiredIndex)
+{
+    if (name.isEmpty()) {
+        name = getNameFromPath(path);
+    }
+    desiredIndex = resolveLayerIndex(path, desiredIndex);
+    ++m_pendingLayers;
+    readLayerAsync(path, [this, path, name, desiredIndex](ConfigLayerData layer) {
+        --m_pendingLayers;
+        if (!insertLayer(std::move(layer), path, name, desiredIndex)) {
+            emit layerLoadFailed(name, path);
+            return;
+        }
+        emit layerLoaded(name);
+        scheduleUpdate();
+    });
+    return name;
+}
+
+// loads several configs at once. Files are read and parsed in parallel, the layers get consecutive indices
+// starting from firstIndex in the order of paths and are applied in a single update. Returns the layer names,
+// empty for the layers that failed to load
+QStringList JsonConfig::loadLayers(const QStringList &paths, const QStringList &names, int firstIndex)
+{
+    QList<ConfigLayerData> data = readLayers(paths);
+    QStringList ret;
+    int index = resolveLayerIndex(paths.value(0), firstIndex);
+    for (int i = 0; i < paths.size(); ++i, ++index) {
+        QString name = names.value(i);
+        if (name.isEmpty()) {
+            name = getNameFromPath(paths[i]);
+        }
+        auto l = insertLayer(std::move(data[i]), paths[i], name, index);
+        ret.append(l ? l->name : QString());
+    }
+    scheduleUpdate();
+    return ret;
+}
+
 void JsonConfig::writeConfig(const QString &path, const QString &layer)
 {
     auto l = getLayer(layer);
     if (!l) {
         return;
     }
-    QString cleanPath = path;
-    if (cleanPath.startsWith("file:///")) {
-        cleanPath = QUrl(cleanPath).toLocalFile();
+    QString error;
+    if (!ConfigWriter::writeFile(localPath(path), m_root.layerTree(l->index), &error)) {
+        qWarning().noquote() << QString("Failed to write file %1: %2").arg(path, error);
+        return;
     }
-    QFile f(cleanPath);
-    if (!f.open(QIODevice::WriteOnly)) {
-        QString msg = QString("Failed to open file %1 for writing: %2").arg(path, f.errorString());
-        qWarning().noquote() << msg;
+    l->modified = false;
+    checkModified();
+}
+
+void JsonConfig::writeConfigAsync(const QString &path, const QString &layer)
+{
+    auto l = getLayer(layer);
+    if (!l) {
+        emit configWritten(path, layer, false);
         return;
     }
-    QJsonDocument doc;
-    doc.setObject(m_root.toJsonObject(l->index));
-    f.write(doc.toJson(QJsonDocument::Indented));
-    f.close();
+    // the values are captured now, later changes don't affect the file being written
+    LayerTree tree = m_root.layerTree(l->index);
     l->modified = false;
     checkModified();
+    auto *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, path, layer]() {
+        watcher->deleteLater();
+        bool ok = watcher->result();
+        if (!ok) {
+            if (auto l = getLayer(layer)) {
+                l->modified = true;
+                checkModified();
+            }
+        }
+        emit configWritten(path, layer, ok);
+    });
+    QString cleanPath = localPath(path);
+    watcher->setFuture(QtConcurrent::run(&m_writerPool, [cleanPath, path, tree = std::move(tree)]() {
+        QString error;
+        if (!ConfigWriter::writeFile(cleanPath, tree, &error)) {
+            qWarning().noquote() << QString("Failed to write file %1: %2").arg(path, error);
+            return false;
+        }
+        return true;
+    }));
 }
 
 void JsonConfig::unloadLayer(const QString &layer)
@@ -186,6 +253,8 @@ void JsonConfig::unloadLayer(const QString &layer)
     }
     m_root.unload(l->index);
     m_layers.remove(layer);
+    m_strings.prune();
+    updateWatchedFiles();
 }
 
 void JsonConfig::activateLayer(const QString &layer)
@@ -195,6 +264,8 @@ void JsonConfig::activateLayer(const QString &layer)
     if (!l || l->active) {
         return;
     }
+    m_stats->switchStarted();
+    m_switchPending = true;
     doActivateLayer(l);
 }
 
@@ -204,12 +275,66 @@ void JsonConfig::deactivateLayer(const QString &layer)
     if (!l || !l->active) {
         return;
     }
+    m_stats->switchStarted();
+    m_switchPending = true;
     doDeactivateLayer(l);
 }
 
+// makes exactly the given layers active, the root config is always active. Unlike a series of activateLayer and
+// deactivateLayer calls, all changes are merged in one pass, so every property is written and notified at most once
+void JsonConfig::applyLayerSet(const QStringList &activeLayers)
+{
+    if (m_updatePending) {
+        update();
+    }
+    for (const auto &name : activeLayers) {
+        if (!m_layers.contains(name)) {
+            qWarning() << "Layer" << name << "not registered";
+        }
+    }
+    QList<Node::LayerPatch> activated;
+    QList<int> deactivated;
+    for (auto &l : m_layers) {
+        bool active = activeLayers.contains(l.name);
+        if (l.index == 0 || l.active == active) {
+            continue;
+        }
+        l.active = active;
+        l.flag = ConfigLayerData::None;
+        if (active) {
+            activated.append({ l.index, l.object });
+        } else {
+            deactivated.append(l.index);
+        }
+    }
+    if (activated.isEmpty() && deactivated.isEmpty()) {
+        return;
+    }
+    m_stats->switchStarted();
+    bool deferred = m_deferChangeSignals;
+    if (!deferred) {
+        beginUpdate();
+    }
+    qint64 spanStart = m_stats->spanStart();
+    m_updating = true;
+    m_root.applyLayers(activated, deactivated);
+    m_updating = false;
+    m_stats->addSpan("applyLayerSet", spanStart);
+    if (!deferred) {
+        endUpdate();
+    }
+    emit activeLayersChanged();
+}
+
 void JsonConfig::clear()
 {
     m_root.clear();
+    m_refGraph.clear();
+    m_nodes.clear();
+    m_strings.clear();
+    m_dirtyProperties.clear();
+    ++m_treeGeneration;
+    publishSnapshot();
     emit configDataChanged();
 }
 
@@ -217,16 +342,34 @@ void JsonConfig::setProperty(const QString &layer, const QString &key, const QVa
 {
     int propIdx = -1;
     Node *n = m_root.getNode(key, &propIdx);
-    auto l = getLayer(layer);
-    if (!l) {
-        return;
-    }
-    if (propIdx != -1) {
-        n->updateProperty(propIdx, l->index, value);
-    }
+    doSetProperty(n, propIdx, layer, value);
 }
 
 QVariant JsonConfig::getProperty(const QString &layer, const QString &key)
+{
+    int propIdx = -1;
+    Node *n = m_root.getNode(key, &propIdx);
+    return doGetProperty(n, propIdx, layer);
+}
+
+void JsonConfig::resetProperty(const QString & layer, const QString & key)
+{
+    int propIdx = -1;
+    Node * n = m_root.getNode(key, &propIdx);
+    doResetProperty(n, propIdx, layer);
+}
+
+// returns a handle which resolves the key path once, for repeated access to the same property
+ConfigHandle *JsonConfig::handle(const QString &key)
+{
+    auto it = m_handles.find(key);
+    if (it == m_handles.end()) {
+        it = m_handles.insert(key, new ConfigHandle(this, key, this));
+    }
+    return it.value();
+}
+
+QVariant JsonConfig::doGetProperty(Node *node, int propertyIndex, const QString &layer)
 {
     int index = 0;
     if (!layer.isEmpty()) {
@@ -237,29 +380,148 @@ QVariant JsonConfig::getProperty(const QString &layer, const QString &key)
         }
         index = it.value().index;
     }
-    int propIdx = -1;
-
-    Node *n = m_root.getNode(key, &propIdx);
-    if (propIdx != -1) {
-        auto &vals = n->properties[propIdx].values;
-        auto it = vals.find(index);
-        if (it != vals.end()) {
-            return it.value();
+    if (propertyIndex != -1) {
+        if (const QVariant *v = node->properties[propertyIndex].values.find(index)) {
+            return *v;
         }
     }
     return {};
 }
 
-void JsonConfig::resetProperty(const QString & layer, const QString & key)
+void JsonConfig::doSetProperty(Node *node, int propertyIndex, const QString &layer, const QVariant &value)
+{
+    auto l = getLayer(layer);
+    if (!l) {
+        return;
+    }
+    if (propertyIndex != -1) {
+        node->updateProperty(propertyIndex, l->index, value);
+        if (l->journal) {
+            journalChange(l, { node->fullPropertyName(node->properties[propertyIndex].key), QJsonValue::fromVariant(value), false });
+        } else {
+            setLayerModified(l, true);
+        }
+    }
+}
+
+void JsonConfig::doResetProperty(Node *node, int propertyIndex, const QString &layer)
+{
+    auto l = getLayer(layer);
+    if (!l) {
+        return;
+    }
+    if (propertyIndex != -1 && l->index > 0) {
+        node->removeProperty(propertyIndex, l->index);
+        if (l->journal) {
+            journalChange(l, { node->fullPropertyName(node->properties[propertyIndex].key), QJsonValue(), true });
+        } else {
+            setLayerModified(l, true);
+        }
+    }
+}
+
+// records a change of a journaled layer. The layer object is patched as well: it's what is applied when the layer
+// is activated again, and what compaction writes. Once the record is appended the change is saved, so the layer
+// is not reported as modified
+void JsonConfig::journalChange(ConfigLayerData *l, const LayerJournal::Record &record)
+{
+    LayerJournal::apply(&l->object, record);
+    if (record.reset) {
+        l->journal->appendReset(record.key);
+    } else {
+        l->journal->append(record.key, record.value);
+    }
+    setLayerModified(l, false);
+    m_journalSyncTimer.start();
+    if (l->journal->needsCompaction()) {
+        compactJournal(l->name);
+    }
+}
+
+void JsonConfig::setLayerModified(ConfigLayerData *l, bool modified)
+{
+    if (l->modified == modified) {
+        return;
+    }
+    l->modified = modified;
+    // the status is updated when loading finishes
+    if (m_status != Loading) {
+        checkModified();
+    }
+}
+
+bool JsonConfig::enableJournal(const QString &layer, const QString &journalPath, qint64 compactionSize)
+{
+    auto l = getLayer(layer);
+    if (!l) {
+        return false;
+    }
+    QString path = journalPath.isEmpty() ? localPath(l->path) + ".journal" : localPath(journalPath);
+    auto journal = std::make_shared<LayerJournal>(path);
+    journal->setCompactionSize(compactionSize);
+    // changes made before a crash or since the last compaction
+    const auto records = journal->records();
+    if (!journal->open()) {
+        return false;
+    }
+    beginUpdate();
+    for (const auto &record : records) {
+        // the layer object is patched also for keys the base config doesn't have, so compaction keeps them
+        LayerJournal::apply(&l->object, record);
+        int propIdx = -1;
+        Node *n = m_root.getNode(record.key, &propIdx);
+        if (propIdx == -1) {
+            qWarning().noquote() << "Journal" << path << "refers to unknown property" << record.key;
+        } else if (record.reset) {
+            doResetProperty(n, propIdx, layer);
+        } else {
+            doSetProperty(n, propIdx, layer, record.value.toVariant());
+        }
+    }
+    endUpdate();
+    l->journal = std::move(journal);
+    return true;
+}
+
+// writes the layer with the journaled changes into the layer file, then drops the records it covers
+void JsonConfig::compactJournal(const QString &layer)
 {
-    int propIdx = -1;
-    Node * n = m_root.getNode(key, &propIdx);
     auto l = getLayer(layer);
-    if (!l) {    
+    if (!l || !l->journal || l->journal->isCompacting()) {
         return;
     }
-    if (propIdx != -1 && l->index > 0) {
-        n->removeProperty(propIdx, l->index);
+    auto journal = l->journal;
+    journal->setCompacting(true);
+    // the layer object holds all records appended so far. It's written whole, rather than the values in the node
+    // tree: an inactive layer has no values there, and keys unknown to the base config or starting with '$' never do
+    qint64 offset = journal->size();
+    LayerTree tree;
+    tree.json = l->object;
+    auto *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [watcher, journal]() {
+        watcher->deleteLater();
+        journal->setCompacting(false);
+    });
+    QString path = localPath(l->path);
+    watcher->setFuture(QtConcurrent::run(&m_writerPool, [path, journal, offset, tree = std::move(tree)]() {
+        QString error;
+        if (!ConfigWriter::writeFile(path, tree, &error)) {
+            qWarning().noquote() << QString("Failed to compact journal into %1: %2").arg(path, error);
+            return false;
+        }
+        return journal->truncate(offset);
+    }));
+}
+
+// fsync can take long on flash storage, so it runs on the writer pool
+void JsonConfig::syncJournals()
+{
+    for (auto &l : m_layers) {
+        if (auto journal = l.journal) {
+            m_writerPool.start([journal]() {
+                journal->sync();
+            });
+        }
     }
 }
 
@@ -270,20 +532,50 @@ void JsonConfig::beginUpdate()
 
 void JsonConfig::endUpdate()
 {
+    // refs are recomputed while signals are still deferred, so dependent properties are notified in the same batch
+    m_refGraph.propagate();
     m_deferChangeSignals = false;
-    m_root.emitDeferredSignals();
+    emitDeferredSignals();
+    publishSnapshot();
+    // a switch requested by activateLayer or deactivateLayer ends with the update applying it, not with an
+    // endUpdate of the caller that ran before
+    if (!m_switchPending) {
+        m_stats->switchFinished();
+    }
+    m_stats->publish();
 }
 
 void JsonConfig::handleAddedChild(int, QObject *object)
 {
     if (auto *qmlLayer = qobject_cast<ConfigLayer*>(object)) {
-        addQmlLayer(qmlLayer);
+        if (!m_deferUpdate) {
+            addQmlLayers({ qmlLayer });
+            return;
+        }
+        // Instantiator adds its objects one by one, collect them to load in a single batch
+        if (m_incomingLayers.isEmpty()) {
+            QMetaObject::invokeMethod(this, &JsonConfig::addIncomingLayers, Qt::QueuedConnection);
+        }
+        m_incomingLayers.append(qmlLayer);
     }
 }
 
+void JsonConfig::addIncomingLayers()
+{
+    QList<ConfigLayer*> layers;
+    for (const auto &l : qAsConst(m_incomingLayers)) {
+        if (l) {
+            layers.append(l);
+        }
+    }
+    m_incomingLayers.clear();
+    addQmlLayers(layers);
+}
+
 void JsonConfig::handleRemovedChild(int, QObject *object)
 {
     if (auto *qmlLayer = qobject_cast<ConfigLayer*>(object)) {
+        m_incomingLayers.removeAll(qmlLayer);
         unloadLayer(qmlLayer->name());
         scheduleUpdate();
     }
@@ -301,9 +593,7 @@ void JsonConfig::classBegin()
 
 void JsonConfig::componentComplete()
 {
-    for (ConfigLayer *l : qAsConst(m_qmlLayers)) {
-        addQmlLayer(l);
-    }
+    addQmlLayers(m_qmlLayers);
 }
 
 bool JsonConfig::event(QEvent *event)
@@ -350,11 +640,24 @@ QObject *JsonConfig::qmlChildrenAt(QQmlListProperty<QObject> *list, qsizetype in
     return o->m_children.at(index);
 }
 
-void JsonConfig::addQmlLayer(ConfigLayer *layer)
+void JsonConfig::addQmlLayers(const QList<ConfigLayer*> &layers)
+{
+    QStringList paths;
+    for (ConfigLayer *l : layers) {
+        paths.append(l->filePath());
+    }
+    QList<ConfigLayerData> data = readLayers(paths);
+    for (int i = 0; i < layers.size(); ++i) {
+        addQmlLayer(layers[i], std::move(data[i]));
+    }
+}
+
+void JsonConfig::addQmlLayer(ConfigLayer *layer, ConfigLayerData data)
 {
     layer->setConfig(this);
     qDebug() << "Adding QML layer" << layer << layer->filePath();
-    auto l = doLoadLayer(layer->filePath(), layer->name(), layer->priority());
+    QString name = layer->name().isEmpty() ? getNameFromPath(layer->filePath()) : layer->name();
+    auto l = insertLayer(std::move(data), layer->filePath(), name, resolveLayerIndex(layer->filePath(), layer->priority()));
     if (!l) {
         qWarning() << "Failed to load layer" << layer->filePath();
         return;
@@ -371,44 +674,229 @@ void JsonConfig::addQmlLayer(ConfigLayer *layer)
 
 JsonConfig::ConfigLayerData *JsonConfig::doLoadLayer(const QString &path, QString name, int desiredIndex)
 {
-    if (desiredIndex < 0) {
-        if (m_layers.empty() && !m_root.object()) {
-            qWarning() << "Loading layer" << path << "before root config";
-            desiredIndex = m_layers.size() + 1;
-        } else {
-            desiredIndex = m_layers.size();
-        }
-    }
+    desiredIndex = resolveLayerIndex(path, desiredIndex);
     if (name.isEmpty()) {
         name = getNameFromPath(path);
     }
-    ConfigLayerData layer = ConfigLayerData::fromFile(path);
+    ConfigLayerData layer = ConfigLayerData::fromFile(path, &m_layerCache);
+    emit cacheStatsChanged();
+    return insertLayer(std::move(layer), path, name, desiredIndex);
+}
+
+JsonConfig::ConfigLayerData *JsonConfig::insertLayer(ConfigLayerData layer, const QString &path, const QString &name, int index)
+{
     if (layer.flag != ConfigLayerData::None) {
         qWarning() << "Layer loading error" << path;
         return nullptr;
     }
     layer.name = name;
-    layer.index = desiredIndex;
+    layer.path = path;
+    layer.index = index;
     layer.flag = ConfigLayerData::Object;
+    m_stats->layerLoaded(name, layer.loadStart, layer.readTime, layer.parseTime);
     auto it = m_layers.insert(name, layer);
     emit layersChanged();
+    updateWatchedFiles();
     return &it.value();
 }
 
+// layers still being loaded asynchronously reserve their indices
+int JsonConfig::resolveLayerIndex(const QString &path, int desiredIndex) const
+{
+    if (desiredIndex >= 0) {
+        return desiredIndex;
+    }
+    int count = m_layers.size() + m_pendingLayers;
+    if (count == 0 && !m_root.isLoaded()) {
+        qWarning() << "Loading layer" << path << "before root config";
+        return 1;
+    }
+    return count;
+}
+
+// reads and parses the files in parallel on the loader pool, blocks until all of them are done
+QList<JsonConfig::ConfigLayerData> JsonConfig::readLayers(const QStringList &paths)
+{
+    QList<ConfigLayerData> ret;
+    if (paths.size() == 1) {
+        ret.append(ConfigLayerData::fromFile(paths.first(), &m_layerCache));
+    } else {
+        LayerCache *cache = &m_layerCache;
+        QList<QFuture<ConfigLayerData>> futures;
+        for (const QString &path : paths) {
+            futures.append(QtConcurrent::run(&m_loaderPool, [path, cache]() {
+                return ConfigLayerData::fromFile(path, cache);
+            }));
+        }
+        for (auto &f : futures) {
+            ret.append(f.result());
+        }
+    }
+    emit cacheStatsChanged();
+    return ret;
+}
+
+// reads and parses the file on the loader pool, onFinished is called in the GUI thread
+// with knownHash given, the file is parsed only if its contents changed, otherwise the result is flagged Unchanged
+void JsonConfig::readLayerAsync(const QString &path, std::function<void (ConfigLayerData)> onFinished, const QByteArray &knownHash)
+{
+    auto *watcher = new QFutureWatcher<ConfigLayerData>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, onFinished]() {
+        watcher->deleteLater();
+        emit cacheStatsChanged();
+        onFinished(watcher->result());
+        finishLoading();
+    });
+    startLoading();
+    LayerCache *cache = &m_layerCache;
+    watcher->setFuture(QtConcurrent::run(&m_loaderPool, [path, cache, knownHash]() {
+        if (knownHash.isEmpty()) {
+            return ConfigLayerData::fromFile(path, cache);
+        }
+        return ConfigLayerData::fromChangedFile(path, knownHash, cache);
+    }));
+}
+
+void JsonConfig::startLoading()
+{
+    ++m_loadsStarted;
+    setStatus(Loading);
+    emit loadingProgressChanged();
+}
+
+void JsonConfig::finishLoading()
+{
+    ++m_loadsFinished;
+    if (m_loadsFinished == m_loadsStarted) {
+        m_loadsStarted = 0;
+        m_loadsFinished = 0;
+        if (m_status == Loading) {
+            checkModified();
+        }
+    }
+    emit loadingProgressChanged();
+}
+
 void JsonConfig::updateLayerPath(const QString &layer, const QString &filePath)
 {
-    auto newLayer = ConfigLayerData::fromFile(filePath);
-    if (newLayer.index != -1) {
+    auto l = getLayer(layer);
+    quint64 generation = l ? ++l->readGeneration : 0;
+    if (m_deferUpdate) {
+        // the layer is applied on a deferred update anyway, so there is no need to block on reading it. Reads
+        // finish in any order: when the path changes again meanwhile, the result of this read is dropped
+        readLayerAsync(filePath, [this, layer, filePath, generation](const ConfigLayerData &newLayer) {
+            auto l = getLayer(layer);
+            if (l && l->readGeneration != generation) {
+                return;
+            }
+            applyLayerFile(layer, filePath, newLayer);
+        });
+    } else {
+        auto newLayer = ConfigLayerData::fromFile(filePath, &m_layerCache);
+        emit cacheStatsChanged();
+        applyLayerFile(layer, filePath, newLayer);
+    }
+}
+
+void JsonConfig::applyLayerFile(const QString &layer, const QString &filePath, const ConfigLayerData &newLayer)
+{
+    if (newLayer.flag != ConfigLayerData::None) {
         setStatus(Error);
         qWarning() << "Error updating layer" << layer << "file loading or parsing error" << filePath;
         return;
     }
     auto l = getLayer(layer);
+    if (!l) {
+        qWarning() << "Layer" << layer << "was unloaded while its file was being loaded";
+        return;
+    }
+    m_stats->layerLoaded(layer, newLayer.loadStart, newLayer.readTime, newLayer.parseTime);
     l->flag = ConfigLayerData::Object;
     l->object = newLayer.object;
+    if (l->journal) {
+        // changes not compacted into the file yet. Records still buffered would be missed by records()
+        l->journal->flush();
+        const auto records = l->journal->records();
+        for (const auto &record : records) {
+            LayerJournal::apply(&l->object, record);
+        }
+    }
+    l->contentHash = newLayer.contentHash;
+    if (l->path != filePath) {
+        l->path = filePath;
+        updateWatchedFiles();
+    }
     scheduleUpdate();
 }
 
+void JsonConfig::updateWatchedFiles()
+{
+    if (!m_watcher) {
+        return;
+    }
+    QSet<QString> paths;
+    for (const auto &l : qAsConst(m_layers)) {
+        // files from resources never change
+        if (!l.path.isEmpty() && !l.path.startsWith(':') && !l.path.startsWith("qrc:")) {
+            paths.insert(l.path);
+        }
+    }
+    const QStringList watched = m_watcher->files();
+    for (const auto &path : watched) {
+        if (!paths.remove(path)) {
+            m_watcher->removePath(path);
+        }
+    }
+    if (!paths.isEmpty()) {
+        m_watcher->addPaths(paths.values());
+    }
+}
+
+void JsonConfig::onLayerFileChanged(const QString &path)
+{
+    // editors and deployment tools often rewrite files in bursts, so changes are collected for a while
+    m_changedFiles.insert(path);
+    m_reloadTimer.start();
+}
+
+void JsonConfig::reloadChangedFiles()
+{
+    const QSet<QString> paths = m_changedFiles;
+    m_changedFiles.clear();
+    // files replaced by renaming are dropped from the watcher, so add them again
+    updateWatchedFiles();
+    for (const auto &path : paths) {
+        QByteArray knownHash;
+        for (const auto &l : qAsConst(m_layers)) {
+            if (l.path == path) {
+                knownHash = l.contentHash;
+                break;
+            }
+        }
+        if (knownHash.isEmpty()) {
+            continue;
+        }
+        QHash<QString, quint64> generations;
+        for (auto &l : m_layers) {
+            if (l.path == path) {
+                generations.insert(l.name, ++l.readGeneration);
+            }
+        }
+        readLayerAsync(path, [this, path, generations](const ConfigLayerData &newLayer) {
+            if (newLayer.flag == ConfigLayerData::Unchanged) {
+                return;
+            }
+            for (auto it = generations.begin(); it != generations.end(); ++it) {
+                // skips layers whose file was read again or changed meanwhile
+                auto l = getLayer(it.key());
+                if (l && l->readGeneration == it.value()) {
+                    applyLayerFile(it.key(), path, newLayer);
+                }
+            }
+        }, knownHash);
+    }
+}
+
 void JsonConfig::doActivateLayer(ConfigLayerData *layer)
 {
     layer->active = true;
@@ -423,6 +911,24 @@ void JsonConfig::doDeactivateLayer(ConfigLayerData *layer)
     scheduleUpdate();
 }
 
+void JsonConfig::emitDeferredSignals()
+{
+    if (m_dirtyProperties.isEmpty()) {
+        return;
+    }
+    qint64 spanStart = m_stats->spanStart();
+    // only the properties changed since the last emission are visited. A property can be listed twice if its
+    // pending flag was reset meanwhile, the flag makes sure it's notified once
+    for (int i = 0; i < m_dirtyProperties.size(); ++i) {
+        const auto d = m_dirtyProperties.at(i);
+        if (d.first->properties[d.second].emitPending) {
+            d.first->notifyPropertyUpdate(d.second);
+        }
+    }
+    m_dirtyProperties.clear();
+    m_stats->addSpan("emit signals", spanStart);
+}
+
 void JsonConfig::scheduleUpdate()
 {
     if (!m_updatePending) {
@@ -437,22 +943,29 @@ void JsonConfig::scheduleUpdate()
 
 void JsonConfig::update()
 {
+    qint64 updateStart = m_stats->spanStart();
     beginUpdate();
+    bool swapped = false;
     QMap<int, ConfigLayerData*> sortedLayers;
     for (auto it = m_layers.begin(); it != m_layers.end(); ++it) {
         sortedLayers.insert(it->index, &it.value());
     }
     for (auto layer : sortedLayers) {
+        qint64 applyStart = layer->flag == ConfigLayerData::None ? 0 : m_stats->spanStart();
         if (layer->flag == ConfigLayerData::Object) {
-            if (layer->index == 0) {
+            if (layer->index == 0 && !m_root.isLoaded()) {
                 m_root.setJsonObject(layer->object);
+                m_refGraph.clear();
+                ++m_treeGeneration;
                 emit configDataChanged();
                 setStatus(ConfigLoaded);
-            } else if (layer->active) {
+            } else if (layer->active || layer->index == 0) {
+                // the set of keys is defined by the root config once it's loaded, so a reloaded root is swapped as any other layer
                 QJsonObject oldObj = m_root.toJsonObject(layer->index);
                 m_updating = true;
                 m_root.swapJsonObject(oldObj, layer->object, layer->index);
                 m_updating = false;
+                swapped = true;
             }
             layer->flag = ConfigLayerData::None;
         } else if (layer->flag == ConfigLayerData::Active) {
@@ -466,9 +979,16 @@ void JsonConfig::update()
             layer->flag = ConfigLayerData::None;
             emit activeLayersChanged();
         }
+        m_stats->layerApplied(layer->name, applyStart);
     }
+    m_switchPending = false;
     endUpdate();
+    // values of a deactivated layer come back when it's activated again, only those of replaced files are dropped
+    if (swapped) {
+        m_strings.prune();
+    }
     m_updatePending = false;
+    m_stats->addSpan("update", updateStart);
 }
 
 void JsonConfig::setStatus(Status newStatus)
@@ -520,6 +1040,170 @@ void JsonConfig::setDeferUpdate(bool newDeferUpdate)
     emit deferUpdateChanged();
 }
 
+const QString &JsonConfig::cacheDir() const
+{
+    return m_layerCache.cacheDir();
+}
+
+void JsonConfig::setCacheDir(const QString &newCacheDir)
+{
+    if (m_layerCache.cacheDir() == newCacheDir) {
+        return;
+    }
+    m_layerCache.setCacheDir(newCacheDir);
+    emit cacheDirChanged();
+}
+
+int JsonConfig::cacheHits() const
+{
+    return m_layerCache.hits();
+}
+
+int JsonConfig::cacheMisses() const
+{
+    return m_layerCache.misses();
+}
+
+bool JsonConfig::watchFiles() const
+{
+    return m_watcher != nullptr;
+}
+
+void JsonConfig::setWatchFiles(bool newWatchFiles)
+{
+    if (watchFiles() == newWatchFiles) {
+        return;
+    }
+    if (newWatchFiles) {
+        m_watcher = new QFileSystemWatcher(this);
+        connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &JsonConfig::onLayerFileChanged);
+        updateWatchedFiles();
+    } else {
+        delete m_watcher;
+        m_watcher = nullptr;
+        m_reloadTimer.stop();
+        m_changedFiles.clear();
+    }
+    emit watchFilesChanged();
+}
+
+int JsonConfig::watchDelay() const
+{
+    return m_reloadTimer.interval();
+}
+
+void JsonConfig::setWatchDelay(int newWatchDelay)
+{
+    if (m_reloadTimer.interval() == newWatchDelay) {
+        return;
+    }
+    m_reloadTimer.setInterval(newWatchDelay);
+    emit watchDelayChanged();
+}
+
+ConfigStats *JsonConfig::stats() const
+{
+    return m_stats;
+}
+
+bool JsonConfig::snapshotsEnabled() const
+{
+    return m_snapshotsEnabled;
+}
+
+void JsonConfig::setSnapshotsEnabled(bool newSnapshotsEnabled)
+{
+    if (m_snapshotsEnabled == newSnapshotsEnabled) {
+        return;
+    }
+    m_snapshotsEnabled = newSnapshotsEnabled;
+    if (m_snapshotsEnabled) {
+        publishSnapshot();
+    } else {
+        std::atomic_store(&m_snapshot, ConfigSnapshotPtr());
+    }
+    emit snapshotsEnabledChanged();
+}
+
+// returns the last published snapshot, or nullptr if snapshots are disabled. Lookups in the snapshot
+// don't lock, it stays valid and unchanged as long as the caller holds it
+ConfigSnapshotPtr JsonConfig::snapshot() const
+{
+    return std::atomic_load(&m_snapshot);
+}
+
+quint64 JsonConfig::snapshotVersion() const
+{
+    return m_snapshotVersion.load(std::memory_order_acquire);
+}
+
+bool JsonConfig::lazyLoading() const
+{
+    return m_lazyLoading;
+}
+
+void JsonConfig::setLazyLoading(bool newLazyLoading)
+{
+    if (m_lazyLoading == newLazyLoading) {
+        return;
+    }
+    m_lazyLoading = newLazyLoading;
+    emit lazyLoadingChanged();
+}
+
+// parts of the active layers at the given path, ordered by priority. Nodes loaded lazily apply them when they are built
+QList<Node::LayerPatch> JsonConfig::activeLayerObjects(const QStringList &path) const
+{
+    QMap<int, QJsonObject> sorted;
+    for (const auto &l : m_layers) {
+        if (l.index > 0 && l.active) {
+            QJsonObject object = subObject(l.object, path);
+            if (!object.isEmpty()) {
+                sorted.insert(l.index, object);
+            }
+        }
+    }
+    QList<Node::LayerPatch> ret;
+    for (auto it = sorted.begin(); it != sorted.end(); ++it) {
+        ret.append({ it.key(), it.value() });
+    }
+    return ret;
+}
+
+// part of the layer at the given path, if the layer is active
+QJsonObject JsonConfig::layerObject(int level, const QStringList &path) const
+{
+    for (const auto &l : m_layers) {
+        if (l.index == level && l.active) {
+            return subObject(l.object, path);
+        }
+    }
+    return {};
+}
+
+// changes made outside of an update are published in one snapshot once control returns to the event loop
+void JsonConfig::scheduleSnapshot()
+{
+    if (!m_snapshotsEnabled || m_snapshotPending || m_deferChangeSignals) {
+        return;
+    }
+    m_snapshotPending = true;
+    QMetaObject::invokeMethod(this, &JsonConfig::publishSnapshot, Qt::QueuedConnection);
+}
+
+// builds a snapshot from the changed subtrees and swaps it in. The version is incremented after the swap,
+// so a reader never sees a version whose snapshot isn't available yet
+void JsonConfig::publishSnapshot()
+{
+    m_snapshotPending = false;
+    if (!m_snapshotsEnabled || (m_snapshot && !m_root.isSnapshotDirty())) {
+        return;
+    }
+    quint64 version = m_snapshotVersion.load(std::memory_order_relaxed) + 1;
+    std::atomic_store(&m_snapshot, ConfigSnapshotPtr(std::make_shared<const ConfigSnapshot>(m_root.snapshot(), version)));
+    m_snapshotVersion.store(version, std::memory_order_release);
+}
+
 void JsonConfig::changeLayerName(const QString &oldName, const QString &newName)
 {
     auto it = m_layers.find(oldName);
@@ -535,37 +1219,99 @@ void JsonConfig::changeLayerName(const QString &oldName, const QString &newName)
 
 void JsonConfig::changeLayerPriority(const QString &name, int priority)
 {
+    qint64 spanStart = m_stats->spanStart();
     if (auto layer = getLayer(name)) {
         m_root.moveLayer(layer->index, priority);
         layer->index = priority;
     }
-    m_root.emitDeferredSignals();
+    m_refGraph.propagate();
+    emitDeferredSignals();
+    publishSnapshot();
+    m_stats->addSpan("changeLayerPriority", spanStart, name);
+    m_stats->publish();
 }
 
-JsonConfig::ConfigLayerData JsonConfig::ConfigLayerData::fromFile(const QString &path)
+JsonConfig::ConfigLayerData JsonConfig::ConfigLayerData::fromFile(const QString &path, LayerCache *cache)
 {
     ConfigLayerData ret;
-    bool ok { false };
-    QByteArray data = readFile(path, &ok);
-    if (!ok) {
+    qint64 start = ConfigStats::now();
+    if (cache && cache->load(path, &ret.object, &ret.contentHash)) {
+        // decoding the cached layer replaces parsing, it's accounted as reading
+        ret.flag = None;
+        ret.loadStart = start;
+        ret.readTime = ConfigStats::now() - start;
+        return ret;
+    }
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning().noquote() << QString("File %1 not found").arg(path);
+        ret.flag = FileError;
+        return ret;
+    }
+    // the file is hashed and parsed chunk by chunk as it is read, it's never held in memory as a whole
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    JsonReader reader(&f);
+    reader.setHash(&hash);
+    ret = fromReader(reader, path);
+    ret.loadStart = start;
+    ret.readTime = reader.readTime();
+    ret.parseTime = ConfigStats::now() - start - ret.readTime;
+    ret.contentHash = hash.result();
+    if (cache && ret.flag == None) {
+        cache->store(path, reader.bytesRead(), ret.contentHash, ret.object);
+    }
+    return ret;
+}
+
+// reads a file known to have been loaded before, and parses it only if its contents changed
+JsonConfig::ConfigLayerData JsonConfig::ConfigLayerData::fromChangedFile(const QString &path, const QByteArray &knownHash, LayerCache *cache)
+{
+    ConfigLayerData ret;
+    qint64 start = ConfigStats::now();
+    QFile f(path);
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    if (!f.open(QIODevice::ReadOnly) || !hash.addData(&f)) {
+        qWarning().noquote() << QString("File %1 not found").arg(path);
         ret.flag = FileError;
         return ret;
     }
-    return fromData(data);
+    if (hash.result() == knownHash) {
+        ret.flag = Unchanged;
+        return ret;
+    }
+    qint64 hashTime = ConfigStats::now() - start;
+    f.seek(0);
+    JsonReader reader(&f);
+    ret = fromReader(reader, path);
+    ret.loadStart = start;
+    ret.readTime = hashTime + reader.readTime();
+    ret.parseTime = ConfigStats::now() - start - ret.readTime;
+    ret.contentHash = hash.result();
+    if (cache && ret.flag == None) {
+        cache->store(path, reader.bytesRead(), ret.contentHash, ret.object);
+    }
+    return ret;
 }
 
 JsonConfig::ConfigLayerData JsonConfig::ConfigLayerData::fromData(const QByteArray &json)
+{
+    JsonReader reader(json);
+    return fromReader(reader, QString());
+}
+
+JsonConfig::ConfigLayerData JsonConfig::ConfigLayerData::fromReader(JsonReader &reader, const QString &source)
 {
     ConfigLayerData ret;
-    bool ok { false };
-    QJsonObject obj = parseData(json, &ok);
-    if (!ok) {
+    JsonObjectBuilder builder;
+    if (!reader.parse(&builder)) {
+        QString where = source.isEmpty() ? QString() : QString(" in %1").arg(source);
+        qWarning().noquote() << QString("Parse error%1 %2").arg(where, reader.error().toString());
         ret.flag = ParseError;
         return ret;
     }
     ret.flag = None;
     ret.index = -1;
-    ret.object = obj;
+    ret.object = builder.takeResult();
     return ret;
 }
 
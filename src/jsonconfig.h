@@ -5,9 +5,24 @@
 #include <QQmlParserStatus>
 #include <QQmlListProperty>
 #include <QPointer>
+#include <QThreadPool>
+#include <QTimer>
+#include <QSet>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include "private/node.h"
+#include "private/nodearena.h"
+#include "private/layercache.h"
+#include "private/layerjournal.h"
+#include "private/refgraph.h"
+#include "private/stringpool.h"
+#include "configstats.h"
 
 class ConfigLayer;
+class ConfigHandle;
+class JsonReader;
+class QFileSystemWatcher;
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
 #define qsizetype int
 #endif
@@ -20,10 +35,19 @@ class JsonConfig : public QObject, public QQmlParserStatus
     Q_PROPERTY(QObject* configData READ configData NOTIFY configDataChanged)
     Q_PROPERTY(bool readonly READ readonly WRITE setReadonly NOTIFY readonlyChanged)
     Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+    Q_PROPERTY(qreal loadingProgress READ loadingProgress NOTIFY loadingProgressChanged)
     Q_PROPERTY(QQmlListProperty<QObject> children READ qmlChildren NOTIFY childrenChanged)
     Q_PROPERTY(bool deferUpdate READ deferUpdate WRITE setDeferUpdate NOTIFY deferUpdateChanged)
     Q_PROPERTY(QStringList layers READ layers NOTIFY layersChanged)
     Q_PROPERTY(QStringList activeLayers READ activeLayers NOTIFY activeLayersChanged)
+    Q_PROPERTY(QString cacheDir READ cacheDir WRITE setCacheDir NOTIFY cacheDirChanged)
+    Q_PROPERTY(int cacheHits READ cacheHits NOTIFY cacheStatsChanged)
+    Q_PROPERTY(int cacheMisses READ cacheMisses NOTIFY cacheStatsChanged)
+    Q_PROPERTY(bool watchFiles READ watchFiles WRITE setWatchFiles NOTIFY watchFilesChanged)
+    Q_PROPERTY(int watchDelay READ watchDelay WRITE setWatchDelay NOTIFY watchDelayChanged)
+    Q_PROPERTY(ConfigStats* stats READ stats CONSTANT)
+    Q_PROPERTY(bool snapshotsEnabled READ snapshotsEnabled WRITE setSnapshotsEnabled NOTIFY snapshotsEnabledChanged)
+    Q_PROPERTY(bool lazyLoading READ lazyLoading WRITE setLazyLoading NOTIFY lazyLoadingChanged)
 
     Q_CLASSINFO("DefaultProperty", "children");
 
@@ -35,7 +59,8 @@ public:
         Null,
         Error,
         ConfigLoaded,
-        ConfigModified
+        ConfigModified,
+        Loading
     };
     Q_ENUM(Status);
 
@@ -48,6 +73,7 @@ public:
     void setReadonly(bool newReadonly);
 
     Status status() const;
+    qreal loadingProgress() const;
 
     bool deferChangeSignals() const;
 
@@ -63,18 +89,51 @@ public:
     QStringList layers() const;
     QStringList activeLayers() const;
 
+    // directory for the compiled layer cache. Caching is disabled while empty. Must be set before filePath
+    const QString &cacheDir() const;
+    void setCacheDir(const QString &newCacheDir);
+    int cacheHits() const;
+    int cacheMisses() const;
+
+    bool watchFiles() const;
+    void setWatchFiles(bool newWatchFiles);
+    int watchDelay() const;
+    void setWatchDelay(int newWatchDelay);
+
+    ConfigStats *stats() const;
+
+    // With snapshots enabled, an immutable snapshot of the effective values is published after every update.
+    // snapshot() and snapshotVersion() can be called from any thread
+    bool snapshotsEnabled() const;
+    void setSnapshotsEnabled(bool newSnapshotsEnabled);
+    ConfigSnapshotPtr snapshot() const;
+    quint64 snapshotVersion() const;
+
+    // build the sections of the root config on first access. Must be set before filePath
+    bool lazyLoading() const;
+    void setLazyLoading(bool newLazyLoading);
+
 public slots:
     void changeLayerName(const QString &oldName, const QString &newName);
     void changeLayerPriority(const QString &name, int priority);
     QString loadLayer(const QString &path, QString name, int desiredIndex = -1);
+    QString loadLayerAsync(const QString &path, QString name, int desiredIndex = -1);
+    QStringList loadLayers(const QStringList &paths, const QStringList &names = {}, int firstIndex = -1);
     void writeConfig(const QString &path, const QString &layer);
+    // writes the layer as it is now on a worker thread, configWritten is emitted when done
+    void writeConfigAsync(const QString &path, const QString &layer);
+    // records setProperty and resetProperty calls on the layer in an append-only journal, next to the layer file
+    // by default. Existing records are replayed. The journal is compacted into the layer file past compactionSize bytes
+    bool enableJournal(const QString &layer, const QString &journalPath = QString(), qint64 compactionSize = 64 * 1024);
     void unloadLayer(const QString &layer);
     void activateLayer(const QString &layer);
     void deactivateLayer(const QString &layer);
+    void applyLayerSet(const QStringList &activeLayers);
     void clear();
     void setProperty(const QString &layer, const QString &key, const QVariant &value);
     QVariant getProperty(const QString &layer, const QString &key);
     void resetProperty(const QString & layer, const QString & key);
+    ConfigHandle *handle(const QString &key);
 
     void beginUpdate();
     void endUpdate();
@@ -83,16 +142,31 @@ private slots:
     void handleAddedChild(int, QObject *object);
     void handleRemovedChild(int, QObject *object);
     void onUserObjectPropertyChanged();
+    void addIncomingLayers();
+    void onLayerFileChanged(const QString &path);
+    void reloadChangedFiles();
+    void publishSnapshot();
+    void syncJournals();
 
 signals:
     void filePathChanged();
     void configDataChanged();
     void readonlyChanged();
     void statusChanged();
+    void loadingProgressChanged();
+    void layerLoaded(const QString &name);
+    void layerLoadFailed(const QString &name, const QString &path);
     void childrenChanged();
     void deferUpdateChanged();
     void layersChanged();
     void activeLayersChanged();
+    void cacheDirChanged();
+    void cacheStatsChanged();
+    void watchFilesChanged();
+    void watchDelayChanged();
+    void snapshotsEnabledChanged();
+    void lazyLoadingChanged();
+    void configWritten(const QString &path, const QString &layer, bool success);
 
 protected:
     virtual void userObjectCreated(Node *node, QObject *object);
@@ -101,46 +175,110 @@ protected:
 private:
     friend class Node;
     friend class ConfigLayer;
+    friend class ConfigHandle;
 
     static const int listenerSlotIndex;
     struct ConfigLayerData {
         int index = -1;
         bool active = false;
         bool modified = false;
-        ConfigLayer *qmlLayer;
+        ConfigLayer *qmlLayer = nullptr;
         QString name;
+        QString path;
+        QByteArray contentHash;
         QJsonObject object;
-        static ConfigLayerData fromFile(const QString &path);
+        std::shared_ptr<LayerJournal> journal;
+        // incremented whenever a read of the layer file is started, results of older reads are dropped
+        quint64 readGeneration = 0;
+        // load timings, see ConfigStats::now()
+        qint64 loadStart = 0;
+        qint64 readTime = 0;
+        qint64 parseTime = 0;
+        static ConfigLayerData fromFile(const QString &path, LayerCache *cache = nullptr);
+        static ConfigLayerData fromChangedFile(const QString &path, const QByteArray &knownHash, LayerCache *cache = nullptr);
         static ConfigLayerData fromData(const QByteArray &json);
+        static ConfigLayerData fromReader(JsonReader &reader, const QString &source);
 
-        enum { Null, FileError, ParseError, None, Active, Object } flag = Null;
+        enum { Null, FileError, ParseError, None, Active, Object, Unchanged } flag = Null;
     };
 
     QString m_filePath;
+    // all nodes except the root, declared before it so they outlive it
+    NodeArena m_nodes;
     Node m_root;
+    RefGraph m_refGraph;
+    // names and short string values of all nodes and layers
+    StringPool m_strings;
+    // properties with deferred change signals, in the order they were changed
+    QVector<QPair<Node*, int>> m_dirtyProperties;
     QMap<QString, ConfigLayerData> m_layers;
     bool m_readonly = false;
     Status m_status = Null;
     QList<QObject*> m_children;
     QList<ConfigLayer*> m_qmlLayers;
+    QList<QPointer<ConfigLayer>> m_incomingLayers;
     bool m_deferChangeSignals = false;
     bool m_updatePending = false;
+    // a layer was activated or deactivated, and the update applying it has not run yet
+    bool m_switchPending = false;
     bool m_deferUpdate = true;
     bool m_updating = false;
+    QHash<QString, ConfigHandle*> m_handles;
+    ConfigStats *m_stats;
+    // only accessed with std::atomic_load and std::atomic_store, readers on other threads may hold older snapshots
+    ConfigSnapshotPtr m_snapshot;
+    std::atomic<quint64> m_snapshotVersion { 0 };
+    bool m_snapshotsEnabled = false;
+    bool m_snapshotPending = false;
+    bool m_lazyLoading = false;
+    // incremented whenever the node tree is rebuilt, so handles know when to resolve their nodes again
+    quint64 m_treeGeneration = 1;
+    LayerCache m_layerCache;
+    // declared after m_layerCache: the pool waits for running loaders on destruction
+    QThreadPool m_loaderPool;
+    QThreadPool m_writerPool;
+    int m_loadsStarted = 0;
+    int m_loadsFinished = 0;
+    int m_pendingLayers = 0;
+    QFileSystemWatcher *m_watcher = nullptr;
+    QTimer m_reloadTimer;
+    QSet<QString> m_changedFiles;
+    // journal records are synced to storage in batches
+    QTimer m_journalSyncTimer;
 
     QQmlListProperty<QObject> qmlChildren();
     static void qmlChildrenAppend(QQmlListProperty<QObject> *list, QObject *object);
     static qsizetype qmlChildrenCount(QQmlListProperty<QObject> *list);
     static QObject *qmlChildrenAt(QQmlListProperty<QObject> *list, qsizetype index);
-    void addQmlLayer(ConfigLayer *layer);
+    void addQmlLayers(const QList<ConfigLayer*> &layers);
+    void addQmlLayer(ConfigLayer *layer, ConfigLayerData data);
     ConfigLayerData *doLoadLayer(const QString &path, QString name, int desiredIndex);
+    ConfigLayerData *insertLayer(ConfigLayerData layer, const QString &path, const QString &name, int index);
+    int resolveLayerIndex(const QString &path, int desiredIndex) const;
+    QList<ConfigLayerData> readLayers(const QStringList &paths);
+    void readLayerAsync(const QString &path, std::function<void(ConfigLayerData)> onFinished, const QByteArray &knownHash = {});
+    void startLoading();
+    void finishLoading();
     void updateLayerPath(const QString& layer, const QString &filePath);
+    void applyLayerFile(const QString &layer, const QString &filePath, const ConfigLayerData &newLayer);
+    void updateWatchedFiles();
 
     void doActivateLayer(ConfigLayerData *layer);
     void doDeactivateLayer(ConfigLayerData *layer);
     void scheduleUpdate();
+    void emitDeferredSignals();
+    void scheduleSnapshot();
+    QList<Node::LayerPatch> activeLayerObjects(const QStringList &path) const;
+    QJsonObject layerObject(int level, const QStringList &path) const;
     void update();
 
+    QVariant doGetProperty(Node *node, int propertyIndex, const QString &layer);
+    void doSetProperty(Node *node, int propertyIndex, const QString &layer, const QVariant &value);
+    void doResetProperty(Node *node, int propertyIndex, const QString &layer);
+    void journalChange(ConfigLayerData *l, const LayerJournal::Record &record);
+    void setLayerModified(ConfigLayerData *l, bool modified);
+    void compactJournal(const QString &layer);
+
     void setStatus(Status newStatus);
     void checkModified();
     ConfigLayerData *getLayer(const QString &name);
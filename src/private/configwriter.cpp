@@ -0,0 +1,274 @@
+#include "configwriter.h"
+
+#include <QDebug>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QLocale>
+#include <QSaveFile>
+
+#include <cmath>
+
+namespace {
+
+// deeper documents can't be read back, see JsonReader
+constexpr int MaxNestingDepth = 1024;
+
+}
+
+bool LayerTree::isEmpty() const
+{
+    return values.empty() && children.empty() && json.isEmpty();
+}
+
+ConfigWriter::ConfigWriter(QIODevice *device)
+    : m_device(device)
+{
+    m_buffer.reserve(BufferSize);
+}
+
+bool ConfigWriter::write(const LayerTree &tree)
+{
+    m_ok = true;
+    m_error.clear();
+    writeTree(tree, 0);
+    m_buffer.append('\n');
+    return flush();
+}
+
+bool ConfigWriter::writeFile(const QString &path, const LayerTree &tree, QString *error)
+{
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) {
+        if (error) {
+            *error = f.errorString();
+        }
+        return false;
+    }
+    ConfigWriter writer(&f);
+    if (!writer.write(tree)) {
+        if (error) {
+            *error = writer.errorString().isEmpty() ? f.errorString() : writer.errorString();
+        }
+        f.cancelWriting();
+        return false;
+    }
+    if (!f.commit()) {
+        if (error) {
+            *error = f.errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+const QString &ConfigWriter::errorString() const
+{
+    return m_error;
+}
+
+void ConfigWriter::writeTree(const LayerTree &tree, int indent) // NOLINT
+{
+    if (!tree.json.isEmpty()) {
+        writeObject(tree.json, indent);
+        return;
+    }
+    if (!checkDepth(indent)) {
+        return;
+    }
+    if (tree.values.empty() && tree.children.empty()) {
+        m_buffer.append("{}");
+        return;
+    }
+    m_buffer.append("{\n");
+    // values and children are both sorted by key, merge them to write the keys in order as QJsonDocument does
+    auto v = tree.values.cbegin();
+    auto c = tree.children.cbegin();
+    bool first = true;
+    while (v != tree.values.cend() || c != tree.children.cend()) {
+        if (!first) {
+            m_buffer.append(",\n");
+        }
+        first = false;
+        if (c == tree.children.cend() || (v != tree.values.cend() && v->key < c->name)) {
+            writeKey(v->key, indent + 1);
+            if (!v->ref.isEmpty()) {
+                writeObject(QJsonObject { { "$ref", v->ref } }, indent + 1);
+            } else {
+                writeValue(QJsonValue::fromVariant(v->value), indent + 1);
+            }
+            ++v;
+        } else {
+            writeKey(c->name, indent + 1);
+            writeTree(*c, indent + 1); // NOLINT
+            ++c;
+        }
+        flushIfFull();
+    }
+    m_buffer.append('\n');
+    writeIndent(indent);
+    m_buffer.append('}');
+}
+
+void ConfigWriter::writeObject(const QJsonObject &object, int indent) // NOLINT
+{
+    if (!checkDepth(indent)) {
+        return;
+    }
+    if (object.isEmpty()) {
+        m_buffer.append("{}");
+        return;
+    }
+    m_buffer.append("{\n");
+    for (auto it = object.begin(); it != object.end(); ++it) {
+        if (it != object.begin()) {
+            m_buffer.append(",\n");
+        }
+        writeKey(it.key(), indent + 1);
+        writeValue(it.value(), indent + 1); // NOLINT
+        flushIfFull();
+    }
+    m_buffer.append('\n');
+    writeIndent(indent);
+    m_buffer.append('}');
+}
+
+void ConfigWriter::writeArray(const QJsonArray &array, int indent) // NOLINT
+{
+    if (!checkDepth(indent)) {
+        return;
+    }
+    if (array.isEmpty()) {
+        m_buffer.append("[]");
+        return;
+    }
+    m_buffer.append("[\n");
+    for (int i = 0; i < array.size(); ++i) {
+        if (i > 0) {
+            m_buffer.append(",\n");
+        }
+        writeIndent(indent + 1);
+        writeValue(array.at(i), indent + 1); // NOLINT
+    }
+    m_buffer.append('\n');
+    writeIndent(indent);
+    m_buffer.append(']');
+}
+
+void ConfigWriter::writeValue(const QJsonValue &value, int indent) // NOLINT
+{
+    switch (value.type()) {
+    case QJsonValue::Bool:
+        m_buffer.append(value.toBool() ? "true" : "false");
+        break;
+    case QJsonValue::Double: {
+        // integers are written as integers, doubles in the shortest form that reads back to the same value
+        QVariant v = value.toVariant();
+        double d = value.toDouble();
+        if (v.userType() == QMetaType::LongLong) {
+            m_buffer.append(QByteArray::number(v.toLongLong()));
+        } else if (std::isfinite(d)) {
+            m_buffer.append(QByteArray::number(d, 'g', QLocale::FloatingPointShortest));
+        } else {
+            m_buffer.append("null");
+        }
+        break;
+    }
+    case QJsonValue::String:
+        writeString(value.toString());
+        break;
+    case QJsonValue::Array:
+        writeArray(value.toArray(), indent); // NOLINT
+        break;
+    case QJsonValue::Object:
+        writeObject(value.toObject(), indent); // NOLINT
+        break;
+    default:
+        m_buffer.append("null");
+        break;
+    }
+}
+
+// an object or array written at indent is at nesting level indent + 1. A layer nested deeper fails to write
+// rather than being saved with parts missing
+bool ConfigWriter::checkDepth(int indent)
+{
+    if (indent < MaxNestingDepth) {
+        return m_ok;
+    }
+    if (m_ok) {
+        m_ok = false;
+        m_error = QStringLiteral("nested deeper than %1 levels").arg(MaxNestingDepth);
+    }
+    return false;
+}
+
+void ConfigWriter::writeKey(const QString &key, int indent)
+{
+    writeIndent(indent);
+    writeString(key);
+    m_buffer.append(": ");
+}
+
+void ConfigWriter::writeString(const QString &s)
+{
+    const QByteArray utf8 = s.toUtf8();
+    m_buffer.append('"');
+    for (char c : utf8) {
+        switch (c) {
+        case '"':
+            m_buffer.append("\\\"");
+            break;
+        case '\\':
+            m_buffer.append("\\\\");
+            break;
+        case '\b':
+            m_buffer.append("\\b");
+            break;
+        case '\f':
+            m_buffer.append("\\f");
+            break;
+        case '\n':
+            m_buffer.append("\\n");
+            break;
+        case '\r':
+            m_buffer.append("\\r");
+            break;
+        case '\t':
+            m_buffer.append("\\t");
+            break;
+        default:
+            if (uchar(c) < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                m_buffer.append("\\u00");
+                m_buffer.append(hex[uchar(c) >> 4]);
+                m_buffer.append(hex[uchar(c) & 0xf]);
+            } else {
+                m_buffer.append(c);
+            }
+            break;
+        }
+    }
+    m_buffer.append('"');
+}
+
+void ConfigWriter::writeIndent(int indent)
+{
+    m_buffer.append(indent * 4, ' ');
+}
+
+void ConfigWriter::flushIfFull()
+{
+    if (m_buffer.size() >= BufferSize) {
+        flush();
+    }
+}
+
+bool ConfigWriter::flush()
+{
+    if (m_ok && !m_buffer.isEmpty()) {
+        m_ok = m_device->write(m_buffer) == m_buffer.size();
+    }
+    // keeps the capacity reserved in the constructor
+    m_buffer.resize(0);
+    return m_ok;
+}
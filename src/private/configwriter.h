@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVariant>
+
+#include <vector>
+
+class QIODevice;
+
+// Values of one layer captured from the node tree, see Node::layerTree. It shares the stored values and doesn't
+// change once captured, so it can be written on another thread while the config keeps changing.
+struct LayerTree
+{
+    struct Value
+    {
+        QString key;
+        QVariant value;
+        // target of a ref value, empty for plain values
+        QString ref;
+    };
+
+    QString name;
+    std::vector<Value> values;
+    std::vector<LayerTree> children;
+    // values of a section not built yet, see Node::lazyJsonObject
+    QJsonObject json;
+
+    bool isEmpty() const;
+};
+
+// Writes a layer tree as indented JSON. The output is produced in the order of the tree and written to the
+// device in 64 KB chunks, without building a QJsonDocument of the layer first.
+class ConfigWriter
+{
+public:
+    explicit ConfigWriter(QIODevice *device);
+
+    bool write(const LayerTree &tree);
+    // reason the last write failed, empty if writing to the device failed
+    const QString &errorString() const;
+
+    // writes the tree to a QSaveFile, so the file at path is replaced only once it's written completely
+    static bool writeFile(const QString &path, const LayerTree &tree, QString *error = nullptr);
+
+private:
+    static constexpr int BufferSize = 64 * 1024;
+
+    void writeTree(const LayerTree &tree, int indent); // NOLINT
+    void writeObject(const QJsonObject &object, int indent); // NOLINT
+    void writeArray(const QJsonArray &array, int indent); // NOLINT
+    void writeValue(const QJsonValue &value, int indent); // NOLINT
+    bool checkDepth(int indent);
+    void writeKey(const QString &key, int indent);
+    void writeString(const QString &s);
+    void writeIndent(int indent);
+    void flushIfFull();
+    bool flush();
+
+    QIODevice *m_device;
+    QByteArray m_buffer;
+    bool m_ok = true;
+    QString m_error;
+};
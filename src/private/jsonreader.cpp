@@ -0,0 +1,660 @@
+#include "jsonreader.h"
+
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QIODevice>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// same limit as QJsonDocument::fromJson, counting the top-level object
+constexpr int MaxNestingDepth = 1024;
+
+bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// well-formed UTF-8 as in RFC 3629: no overlong forms, surrogates or code points past U+10FFFF
+bool isValidUtf8(const char *p, const char *end)
+{
+    while (p != end) {
+        uchar c = uchar(*p++);
+        if (c < 0x80) {
+            continue;
+        }
+        int extra = 0;
+        uint code = 0;
+        uint min = 0;
+        if ((c & 0xe0) == 0xc0) {
+            extra = 1;
+            code = c & 0x1f;
+            min = 0x80;
+        } else if ((c & 0xf0) == 0xe0) {
+            extra = 2;
+            code = c & 0x0f;
+            min = 0x800;
+        } else if ((c & 0xf8) == 0xf0) {
+            extra = 3;
+            code = c & 0x07;
+            min = 0x10000;
+        } else {
+            return false;
+        }
+        if (end - p < extra) {
+            return false;
+        }
+        for (int i = 0; i < extra; ++i) {
+            uchar next = uchar(*p++);
+            if ((next & 0xc0) != 0x80) {
+                return false;
+            }
+            code = (code << 6) | (next & 0x3f);
+        }
+        if (code < min || code > 0x10ffff || (code >= 0xd800 && code < 0xe000)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void appendUtf8(QByteArray *out, uint code)
+{
+    if (code < 0x80) {
+        out->append(char(code));
+    } else if (code < 0x800) {
+        out->append(char(0xc0 | (code >> 6)));
+        out->append(char(0x80 | (code & 0x3f)));
+    } else if (code < 0x10000) {
+        out->append(char(0xe0 | (code >> 12)));
+        out->append(char(0x80 | ((code >> 6) & 0x3f)));
+        out->append(char(0x80 | (code & 0x3f)));
+    } else {
+        out->append(char(0xf0 | (code >> 18)));
+        out->append(char(0x80 | ((code >> 12) & 0x3f)));
+        out->append(char(0x80 | ((code >> 6) & 0x3f)));
+        out->append(char(0x80 | (code & 0x3f)));
+    }
+}
+
+}
+
+bool JsonReader::Error::isError() const
+{
+    return !message.isEmpty();
+}
+
+QString JsonReader::Error::toString() const
+{
+    return QString("at line %1, column %2: %3").arg(line).arg(column).arg(message);
+}
+
+JsonReader::JsonReader(QIODevice *device, int chunkSize)
+    : m_device(device),
+      m_chunkSize(std::max(chunkSize, 1))
+{
+}
+
+JsonReader::JsonReader(QByteArray data)
+    : m_buffer(std::move(data))
+{
+    m_p = m_buffer.constData();
+    m_end = m_p + m_buffer.size();
+}
+
+void JsonReader::setHash(QCryptographicHash *hash)
+{
+    m_hash = hash;
+}
+
+bool JsonReader::parse(Handler *handler)
+{
+    char c = 0;
+    if (!skipBom()) {
+        return false;
+    }
+    if (!skipWhitespace(&c)) {
+        return fail(QStringLiteral("document is empty"));
+    }
+    if (c != '{') {
+        return fail(QStringLiteral("JSON must contain an object"));
+    }
+    if (!parseObject(handler, 0)) {
+        return false;
+    }
+    if (skipWhitespace(&c)) {
+        return fail(QStringLiteral("garbage at the end of the document"));
+    }
+    return !m_error.isError();
+}
+
+const JsonReader::Error &JsonReader::error() const
+{
+    return m_error;
+}
+
+qint64 JsonReader::bytesRead() const
+{
+    return m_bufferOffset + m_buffer.size();
+}
+
+qint64 JsonReader::readTime() const
+{
+    return m_readTime;
+}
+
+bool JsonReader::fill()
+{
+    if (m_p != m_end) {
+        return true;
+    }
+    if (!m_device) {
+        return false;
+    }
+    m_bufferOffset += m_buffer.size();
+    QElapsedTimer timer;
+    timer.start();
+    m_buffer.resize(m_chunkSize);
+    qint64 n = m_device->read(m_buffer.data(), m_chunkSize);
+    m_readTime += timer.nsecsElapsed();
+    if (n < 0) {
+        QString message = QStringLiteral("read error: %1").arg(m_device->errorString());
+        m_device = nullptr;
+        m_buffer.clear();
+        m_p = m_end = m_buffer.constData();
+        return fail(message);
+    }
+    m_buffer.resize(int(n));
+    m_p = m_buffer.constData();
+    m_end = m_p + n;
+    if (m_hash && n > 0) {
+        m_hash->addData(m_buffer);
+    }
+    return n > 0;
+}
+
+bool JsonReader::peek(char *c)
+{
+    if (!fill()) {
+        return false;
+    }
+    *c = *m_p;
+    return true;
+}
+
+bool JsonReader::skipWhitespace(char *c)
+{
+    while (peek(c)) {
+        if (!isWhitespace(*c)) {
+            return true;
+        }
+        advance();
+    }
+    return false;
+}
+
+// skips a UTF-8 byte order mark at the start of the input, as QJsonDocument::fromJson does
+bool JsonReader::skipBom()
+{
+    static const char bom[] = "\xef\xbb\xbf";
+    for (int i = 0; i < 3; ++i) {
+        char c = 0;
+        if (!peek(&c) || c != bom[i]) {
+            // a partial mark is not valid JSON either
+            return i == 0 || fail(QStringLiteral("illegal value"));
+        }
+        advance();
+    }
+    return true;
+}
+
+void JsonReader::advance()
+{
+    if (*m_p == '\n') {
+        ++m_line;
+        m_lineStart = position() + 1;
+    }
+    ++m_p;
+}
+
+qint64 JsonReader::position() const
+{
+    return m_bufferOffset + (m_p - m_buffer.constData());
+}
+
+bool JsonReader::fail(const QString &message)
+{
+    if (!m_error.isError()) {
+        m_error.message = message;
+        m_error.offset = position();
+        m_error.line = m_line;
+        m_error.column = int(m_error.offset - m_lineStart) + 1;
+    }
+    return false;
+}
+
+bool JsonReader::parseValue(Handler *handler, int depth) // NOLINT
+{
+    char c = 0;
+    if (!skipWhitespace(&c)) {
+        return fail(QStringLiteral("unexpected end of the document"));
+    }
+    switch (c) {
+    case '{':
+        return parseObject(handler, depth + 1); // NOLINT
+    case '[':
+        return parseArray(handler, depth + 1); // NOLINT
+    case '"': {
+        QString s;
+        if (!parseString(&s)) {
+            return false;
+        }
+        handler->value(QJsonValue(s));
+        return true;
+    }
+    case 't':
+        if (!parseLiteral("true")) {
+            return false;
+        }
+        handler->value(QJsonValue(true));
+        return true;
+    case 'f':
+        if (!parseLiteral("false")) {
+            return false;
+        }
+        handler->value(QJsonValue(false));
+        return true;
+    case 'n':
+        if (!parseLiteral("null")) {
+            return false;
+        }
+        handler->value(QJsonValue(QJsonValue::Null));
+        return true;
+    default: {
+        if (c != '-' && !isDigit(c)) {
+            return fail(QStringLiteral("illegal value"));
+        }
+        QJsonValue v;
+        if (!parseNumber(&v)) {
+            return false;
+        }
+        handler->value(v);
+        return true;
+    }
+    }
+}
+
+bool JsonReader::parseObject(Handler *handler, int depth) // NOLINT
+{
+    if (depth >= MaxNestingDepth) {
+        return fail(QStringLiteral("too deeply nested"));
+    }
+    advance(); // '{'
+    handler->beginObject();
+    char c = 0;
+    if (!skipWhitespace(&c)) {
+        return fail(QStringLiteral("unterminated object"));
+    }
+    if (c == '}') {
+        advance();
+        handler->endObject();
+        return true;
+    }
+    for (;;) {
+        if (c != '"') {
+            return fail(QStringLiteral("expected a member name"));
+        }
+        QString key;
+        if (!parseString(&key)) {
+            return false;
+        }
+        if (!skipWhitespace(&c) || c != ':') {
+            return fail(QStringLiteral("expected ':' after a member name"));
+        }
+        advance();
+        handler->key(std::move(key));
+        if (!parseValue(handler, depth)) { // NOLINT
+            return false;
+        }
+        if (!skipWhitespace(&c)) {
+            return fail(QStringLiteral("unterminated object"));
+        }
+        if (c == '}') {
+            advance();
+            handler->endObject();
+            return true;
+        }
+        if (c != ',') {
+            return fail(QStringLiteral("expected ',' or '}' in an object"));
+        }
+        advance();
+        if (!skipWhitespace(&c)) {
+            return fail(QStringLiteral("unterminated object"));
+        }
+    }
+}
+
+bool JsonReader::parseArray(Handler *handler, int depth) // NOLINT
+{
+    if (depth >= MaxNestingDepth) {
+        return fail(QStringLiteral("too deeply nested"));
+    }
+    advance(); // '['
+    handler->beginArray();
+    char c = 0;
+    if (!skipWhitespace(&c)) {
+        return fail(QStringLiteral("unterminated array"));
+    }
+    if (c == ']') {
+        advance();
+        handler->endArray();
+        return true;
+    }
+    for (;;) {
+        if (!parseValue(handler, depth)) { // NOLINT
+            return false;
+        }
+        if (!skipWhitespace(&c)) {
+            return fail(QStringLiteral("unterminated array"));
+        }
+        if (c == ']') {
+            advance();
+            handler->endArray();
+            return true;
+        }
+        if (c != ',') {
+            return fail(QStringLiteral("expected ',' or ']' in an array"));
+        }
+        advance();
+    }
+}
+
+bool JsonReader::parseString(QString *s)
+{
+    advance(); // '"'
+    QByteArray utf8;
+    for (;;) {
+        if (!fill()) {
+            return fail(QStringLiteral("unterminated string"));
+        }
+        // copy the plain part of the string available in the buffer at once
+        const char *start = m_p;
+        while (m_p != m_end && *m_p != '"' && *m_p != '\\' && uchar(*m_p) >= 0x20) {
+            ++m_p;
+        }
+        utf8.append(start, int(m_p - start));
+        if (m_p == m_end) {
+            continue;
+        }
+        char c = *m_p;
+        if (c == '"') {
+            // QString::fromUtf8 would replace invalid sequences silently
+            if (!isValidUtf8(utf8.constData(), utf8.constData() + utf8.size())) {
+                return fail(QStringLiteral("invalid UTF-8 string"));
+            }
+            advance();
+            *s = QString::fromUtf8(utf8);
+            return true;
+        }
+        if (c != '\\') {
+            return fail(QStringLiteral("control character in a string"));
+        }
+        advance();
+        if (!parseEscape(&utf8)) {
+            return false;
+        }
+    }
+}
+
+bool JsonReader::parseEscape(QByteArray *utf8)
+{
+    char c = 0;
+    if (!peek(&c)) {
+        return fail(QStringLiteral("unterminated string"));
+    }
+    advance();
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+        utf8->append(c);
+        return true;
+    case 'b':
+        utf8->append('\b');
+        return true;
+    case 'f':
+        utf8->append('\f');
+        return true;
+    case 'n':
+        utf8->append('\n');
+        return true;
+    case 'r':
+        utf8->append('\r');
+        return true;
+    case 't':
+        utf8->append('\t');
+        return true;
+    case 'u':
+        break;
+    default:
+        return fail(QStringLiteral("illegal escape sequence"));
+    }
+    auto readHex = [this](uint *code) {
+        *code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char h = 0;
+            int v = peek(&h) ? hexValue(h) : -1;
+            if (v < 0) {
+                return false;
+            }
+            advance();
+            *code = (*code << 4) | uint(v);
+        }
+        return true;
+    };
+    uint code = 0;
+    if (!readHex(&code)) {
+        return fail(QStringLiteral("illegal unicode escape"));
+    }
+    if (code >= 0xd800 && code < 0xdc00) {
+        // high surrogate, the low one has to follow as another escape
+        char b = 0;
+        char u = 0;
+        uint low = 0;
+        if (!peek(&b) || b != '\\') {
+            return fail(QStringLiteral("unpaired surrogate"));
+        }
+        advance();
+        if (!peek(&u) || u != 'u') {
+            return fail(QStringLiteral("unpaired surrogate"));
+        }
+        advance();
+        if (!readHex(&low) || low < 0xdc00 || low >= 0xe000) {
+            return fail(QStringLiteral("unpaired surrogate"));
+        }
+        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+    } else if (code >= 0xdc00 && code < 0xe000) {
+        return fail(QStringLiteral("unpaired surrogate"));
+    }
+    appendUtf8(utf8, code);
+    return true;
+}
+
+bool JsonReader::parseNumber(QJsonValue *v)
+{
+    QByteArray text;
+    bool isInteger = true;
+    auto digits = [this, &text]() {
+        char c = 0;
+        int count = 0;
+        while (peek(&c) && isDigit(c)) {
+            text.append(c);
+            advance();
+            ++count;
+        }
+        return count;
+    };
+
+    char c = 0;
+    if (peek(&c) && c == '-') {
+        text.append(c);
+        advance();
+    }
+    if (!peek(&c) || !isDigit(c)) {
+        return fail(QStringLiteral("illegal number"));
+    }
+    if (c == '0') {
+        text.append(c);
+        advance();
+    } else {
+        digits();
+    }
+    if (peek(&c) && c == '.') {
+        isInteger = false;
+        text.append(c);
+        advance();
+        if (digits() == 0) {
+            return fail(QStringLiteral("illegal number"));
+        }
+    }
+    if (peek(&c) && (c == 'e' || c == 'E')) {
+        isInteger = false;
+        text.append(c);
+        advance();
+        if (peek(&c) && (c == '+' || c == '-')) {
+            text.append(c);
+            advance();
+        }
+        if (digits() == 0) {
+            return fail(QStringLiteral("illegal number"));
+        }
+    }
+    if (isInteger) {
+        bool ok = false;
+        qint64 i = text.toLongLong(&ok);
+        if (ok) {
+            *v = QJsonValue(i);
+            return true;
+        }
+    }
+    bool ok = false;
+    double d = text.toDouble(&ok);
+    if (!ok) {
+        return fail(QStringLiteral("number out of range"));
+    }
+    *v = QJsonValue(d);
+    return true;
+}
+
+bool JsonReader::parseLiteral(const char *literal)
+{
+    for (const char *l = literal; *l; ++l) {
+        char c = 0;
+        if (!peek(&c) || c != *l) {
+            return fail(QStringLiteral("illegal value"));
+        }
+        advance();
+    }
+    return true;
+}
+
+void JsonObjectBuilder::beginObject()
+{
+    push(true);
+}
+
+void JsonObjectBuilder::endObject()
+{
+    Frame frame = pop();
+    // stable, so that the last of duplicate keys is inserted last and wins
+    std::stable_sort(frame.members.begin(), frame.members.end(), [](const auto &a, const auto &b) {
+        return a.first < b.first;
+    });
+    QJsonObject object;
+    for (auto &member : frame.members) {
+        object.insert(member.first, member.second);
+    }
+    m_key = std::move(frame.key);
+    add(QJsonValue(object));
+}
+
+void JsonObjectBuilder::beginArray()
+{
+    push(false);
+}
+
+void JsonObjectBuilder::endArray()
+{
+    Frame frame = pop();
+    m_key = std::move(frame.key);
+    add(QJsonValue(frame.array));
+}
+
+void JsonObjectBuilder::key(QString key)
+{
+    m_key = std::move(key);
+}
+
+void JsonObjectBuilder::value(QJsonValue value)
+{
+    add(std::move(value));
+}
+
+QJsonObject JsonObjectBuilder::takeResult()
+{
+    QJsonObject ret;
+    std::swap(ret, m_result);
+    return ret;
+}
+
+void JsonObjectBuilder::push(bool isObject)
+{
+    Frame frame;
+    frame.isObject = isObject;
+    frame.key = std::move(m_key);
+    m_key.clear();
+    m_stack.push_back(std::move(frame));
+}
+
+JsonObjectBuilder::Frame JsonObjectBuilder::pop()
+{
+    Frame frame = std::move(m_stack.back());
+    m_stack.pop_back();
+    return frame;
+}
+
+void JsonObjectBuilder::add(QJsonValue value)
+{
+    if (m_stack.empty()) {
+        m_result = value.toObject();
+        return;
+    }
+    Frame &frame = m_stack.back();
+    if (frame.isObject) {
+        frame.members.emplace_back(std::move(m_key), std::move(value));
+        m_key.clear();
+    } else {
+        frame.array.append(value);
+    }
+}
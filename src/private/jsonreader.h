@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+#include <utility>
+#include <vector>
+
+class QCryptographicHash;
+class QIODevice;
+
+// JSON reader taking its input from a device in fixed-size chunks, or from memory, so the document text is never
+// held in memory as a whole. Parsed values are reported to a handler; layers use JsonObjectBuilder, which builds
+// the same QJsonObject as QJsonDocument::fromJson. Errors are reported as soon as they are found, with the line
+// and column where parsing stopped.
+class JsonReader
+{
+public:
+    class Handler
+    {
+    public:
+        virtual ~Handler() = default;
+        virtual void beginObject() = 0;
+        virtual void endObject() = 0;
+        virtual void beginArray() = 0;
+        virtual void endArray() = 0;
+        virtual void key(QString key) = 0;
+        virtual void value(QJsonValue value) = 0;
+    };
+
+    struct Error
+    {
+        QString message;
+        qint64 offset = -1;
+        int line = 0;
+        int column = 0;
+
+        bool isError() const;
+        QString toString() const;
+    };
+
+    static constexpr int DefaultChunkSize = 64 * 1024;
+
+    explicit JsonReader(QIODevice *device, int chunkSize = DefaultChunkSize);
+    explicit JsonReader(QByteArray data);
+
+    // every chunk read from the device is added to the hash as well
+    void setHash(QCryptographicHash *hash);
+
+    // parses a document whose top-level value is an object
+    bool parse(Handler *handler);
+    const Error &error() const;
+    qint64 bytesRead() const;
+    // time spent reading the device in nanoseconds
+    qint64 readTime() const;
+
+private:
+    bool fill();
+    bool peek(char *c);
+    bool skipWhitespace(char *c);
+    bool skipBom();
+    void advance();
+    qint64 position() const;
+    bool fail(const QString &message);
+    bool parseValue(Handler *handler, int depth); // NOLINT
+    bool parseObject(Handler *handler, int depth); // NOLINT
+    bool parseArray(Handler *handler, int depth); // NOLINT
+    bool parseString(QString *s);
+    bool parseEscape(QByteArray *utf8);
+    bool parseNumber(QJsonValue *v);
+    bool parseLiteral(const char *literal);
+
+    QIODevice *m_device = nullptr;
+    QCryptographicHash *m_hash = nullptr;
+    int m_chunkSize = DefaultChunkSize;
+    QByteArray m_buffer;
+    const char *m_p = nullptr;
+    const char *m_end = nullptr;
+    // offset of the buffer in the input
+    qint64 m_bufferOffset = 0;
+    int m_line = 1;
+    qint64 m_lineStart = 0;
+    qint64 m_readTime = 0;
+    Error m_error;
+};
+
+// Handler building a QJsonObject. The members of an object are collected and inserted in key order once the
+// object is complete: QJsonObject keeps its keys sorted, so each insertion is an append.
+class JsonObjectBuilder : public JsonReader::Handler
+{
+public:
+    void beginObject() override;
+    void endObject() override;
+    void beginArray() override;
+    void endArray() override;
+    void key(QString key) override;
+    void value(QJsonValue value) override;
+
+    QJsonObject takeResult();
+
+private:
+    struct Frame
+    {
+        bool isObject = true;
+        QString key;
+        std::vector<std::pair<QString, QJsonValue>> members;
+        QJsonArray array;
+    };
+
+    void push(bool isObject);
+    Frame pop();
+    void add(QJsonValue value);
+
+    std::vector<Frame> m_stack;
+    QString m_key;
+    QJsonObject m_result;
+};
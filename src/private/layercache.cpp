@@ -0,0 +1,369 @@
+#include "layercache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonValue>
+#include <QSaveFile>
+#include <QVariant>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr quint32 CacheMagic = 0x42434543; // "CECB"
+constexpr quint32 CacheVersion = 1;
+// same limit as JsonReader, so every layer it reads can be cached
+constexpr int MaxNestingDepth = 1024;
+
+enum Tag : quint8
+{
+    TagNull,
+    TagFalse,
+    TagTrue,
+    TagInteger,
+    TagDouble,
+    TagString,
+    TagArray,
+    TagObject
+};
+
+// cache files are machine-local, so the header and payload use native byte order
+struct CacheHeader
+{
+    quint32 magic = CacheMagic;
+    quint32 version = CacheVersion;
+    qint64 sourceSize = 0;
+    qint64 sourceMtime = 0;
+    char sourceHash[16] = {};
+};
+
+template<typename T>
+void appendRaw(QByteArray &out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), int(sizeof(T))); // NOLINT
+}
+
+void encodeString(QByteArray &out, const QString &s)
+{
+    appendRaw<quint32>(out, quint32(s.size()));
+    out.append(reinterpret_cast<const char*>(s.utf16()), int(s.size() * sizeof(QChar))); // NOLINT
+}
+
+void encodeValue(QByteArray &out, const QJsonValue &v) // NOLINT
+{
+    switch (v.type()) {
+    case QJsonValue::Bool:
+        appendRaw<quint8>(out, v.toBool() ? TagTrue : TagFalse);
+        break;
+    case QJsonValue::Double: {
+        // keep integers apart from doubles, the property type of generated objects depends on it
+        QVariant var = v.toVariant();
+        if (var.userType() == QMetaType::LongLong) {
+            appendRaw<quint8>(out, TagInteger);
+            appendRaw<qint64>(out, var.toLongLong());
+        } else {
+            appendRaw<quint8>(out, TagDouble);
+            appendRaw<double>(out, v.toDouble());
+        }
+        break;
+    }
+    case QJsonValue::String:
+        appendRaw<quint8>(out, TagString);
+        encodeString(out, v.toString());
+        break;
+    case QJsonValue::Array: {
+        const QJsonArray array = v.toArray();
+        appendRaw<quint8>(out, TagArray);
+        appendRaw<quint32>(out, quint32(array.size()));
+        for (const auto &e : array) {
+            encodeValue(out, e); // NOLINT
+        }
+        break;
+    }
+    case QJsonValue::Object: {
+        const QJsonObject object = v.toObject();
+        appendRaw<quint8>(out, TagObject);
+        appendRaw<quint32>(out, quint32(object.size()));
+        for (auto it = object.begin(); it != object.end(); ++it) {
+            encodeString(out, it.key());
+            encodeValue(out, it.value()); // NOLINT
+        }
+        break;
+    }
+    default:
+        appendRaw<quint8>(out, TagNull);
+        break;
+    }
+}
+
+class Reader
+{
+public:
+    Reader(const uchar *data, qint64 size)
+        : m_p(data),
+          m_end(data + size)
+    {}
+
+    template<typename T>
+    bool read(T *value)
+    {
+        if (m_end - m_p < qint64(sizeof(T))) {
+            return false;
+        }
+        memcpy(value, m_p, sizeof(T));
+        m_p += sizeof(T);
+        return true;
+    }
+
+    bool readString(QString *s)
+    {
+        quint32 len = 0;
+        if (!read(&len)) {
+            return false;
+        }
+        qint64 bytes = qint64(len) * qint64(sizeof(QChar));
+        if (m_end - m_p < bytes) {
+            return false;
+        }
+        *s = QString(int(len), Qt::Uninitialized);
+        memcpy(s->data(), m_p, size_t(bytes));
+        m_p += bytes;
+        return true;
+    }
+
+    bool readValue(QJsonValue *v, int depth) // NOLINT
+    {
+        quint8 tag = 0;
+        if (!read(&tag)) {
+            return false;
+        }
+        switch (tag) {
+        case TagNull:
+            *v = QJsonValue();
+            return true;
+        case TagFalse:
+        case TagTrue:
+            *v = QJsonValue(tag == TagTrue);
+            return true;
+        case TagInteger: {
+            qint64 i = 0;
+            if (!read(&i)) {
+                return false;
+            }
+            *v = QJsonValue(i);
+            return true;
+        }
+        case TagDouble: {
+            double d = 0;
+            if (!read(&d)) {
+                return false;
+            }
+            *v = QJsonValue(d);
+            return true;
+        }
+        case TagString: {
+            QString s;
+            if (!readString(&s)) {
+                return false;
+            }
+            *v = QJsonValue(s);
+            return true;
+        }
+        case TagArray: {
+            quint32 count = 0;
+            if (depth >= MaxNestingDepth || !read(&count)) {
+                return false;
+            }
+            QJsonArray array;
+            for (quint32 i = 0; i < count; ++i) {
+                QJsonValue e;
+                if (!readValue(&e, depth + 1)) { // NOLINT
+                    return false;
+                }
+                array.append(e);
+            }
+            *v = array;
+            return true;
+        }
+        case TagObject: {
+            quint32 count = 0;
+            if (depth >= MaxNestingDepth || !read(&count)) {
+                return false;
+            }
+            QJsonObject object;
+            for (quint32 i = 0; i < count; ++i) {
+                QString key;
+                QJsonValue e;
+                if (!readString(&key) || !readValue(&e, depth + 1)) { // NOLINT
+                    return false;
+                }
+                object.insert(key, e);
+            }
+            *v = object;
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    bool atEnd() const
+    {
+        return m_p == m_end;
+    }
+
+private:
+    const uchar *m_p;
+    const uchar *m_end;
+};
+
+}
+
+LayerCache::LayerCache(QString cacheDir)
+    : m_cacheDir(std::move(cacheDir))
+{
+}
+
+const QString &LayerCache::cacheDir() const
+{
+    return m_cacheDir;
+}
+
+void LayerCache::setCacheDir(const QString &newCacheDir)
+{
+    m_cacheDir = newCacheDir;
+}
+
+bool LayerCache::isEnabled() const
+{
+    return !m_cacheDir.isEmpty();
+}
+
+bool LayerCache::load(const QString &path, QJsonObject *object, QByteArray *sourceHash)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+    QFileInfo source(path);
+    QFile f(cacheFilePath(path));
+    if (!source.exists() || !f.open(QIODevice::ReadOnly) || f.size() < qint64(sizeof(CacheHeader))) {
+        ++m_misses;
+        return false;
+    }
+    uchar *data = f.map(0, f.size());
+    if (!data) {
+        ++m_misses;
+        return false;
+    }
+    CacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    bool valid = header.magic == CacheMagic && header.version == CacheVersion && header.sourceSize == source.size();
+    bool refresh = false;
+    if (valid && header.sourceMtime != source.lastModified().toMSecsSinceEpoch()) {
+        // timestamp differs (e.g. the file was copied or touched), fall back to comparing the contents
+        QFile s(path);
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        if (s.open(QIODevice::ReadOnly) && hash.addData(&s)) {
+            valid = hash.result() == QByteArray(header.sourceHash, int(sizeof(header.sourceHash)));
+            refresh = valid;
+        } else {
+            valid = false;
+        }
+    }
+    if (valid && !decode(data + sizeof(CacheHeader), f.size() - qint64(sizeof(CacheHeader)), object)) {
+        qWarning().noquote() << "Corrupted layer cache" << f.fileName();
+        valid = false;
+    }
+    f.unmap(data);
+    f.close();
+    if (!valid) {
+        ++m_misses;
+        return false;
+    }
+    QByteArray hash(header.sourceHash, int(sizeof(header.sourceHash)));
+    if (refresh) {
+        store(path, header.sourceSize, hash, *object);
+    }
+    if (sourceHash) {
+        *sourceHash = hash;
+    }
+    ++m_hits;
+    return true;
+}
+
+void LayerCache::store(const QString &path, qint64 sourceSize, const QByteArray &sourceHash, const QJsonObject &object)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    if (!QDir().mkpath(m_cacheDir)) {
+        qWarning().noquote() << "Failed to create layer cache directory" << m_cacheDir;
+        return;
+    }
+    CacheHeader header;
+    header.sourceSize = sourceSize;
+    header.sourceMtime = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+    memcpy(header.sourceHash, sourceHash.constData(), std::min(sizeof(header.sourceHash), size_t(sourceHash.size())));
+
+    QSaveFile f(cacheFilePath(path));
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning().noquote() << "Failed to open layer cache" << f.fileName() << "for writing:" << f.errorString();
+        return;
+    }
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header)); // NOLINT
+    f.write(encode(object));
+    if (!f.commit()) {
+        qWarning().noquote() << "Failed to write layer cache" << f.fileName() << f.errorString();
+    }
+}
+
+int LayerCache::hits() const
+{
+    return m_hits;
+}
+
+int LayerCache::misses() const
+{
+    return m_misses;
+}
+
+void LayerCache::resetCounters()
+{
+    m_hits = 0;
+    m_misses = 0;
+}
+
+QByteArray LayerCache::contentHash(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Md5);
+}
+
+QByteArray LayerCache::encode(const QJsonObject &object)
+{
+    QByteArray out;
+    encodeValue(out, object);
+    return out;
+}
+
+bool LayerCache::decode(const uchar *data, qint64 size, QJsonObject *object)
+{
+    Reader r(data, size);
+    QJsonValue v;
+    if (!r.readValue(&v, 0) || !v.isObject() || !r.atEnd()) {
+        return false;
+    }
+    *object = v.toObject();
+    return true;
+}
+
+QString LayerCache::cacheFilePath(const QString &path) const
+{
+    QByteArray key = QCryptographicHash::hash(QFileInfo(path).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QDir(m_cacheDir).filePath(QString::fromLatin1(key.toHex()) + QStringLiteral(".layercache"));
+}
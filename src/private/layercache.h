@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QJsonObject>
+
+#include <atomic>
+
+// On-disk cache of parsed layer files. Each layer is stored in a compact binary form next to
+// the metadata of its source (size, modification time and content hash), so the next load can
+// map the cache file and decode it without running the JSON text parser.
+class LayerCache
+{
+public:
+    explicit LayerCache(QString cacheDir = {});
+
+    const QString &cacheDir() const;
+    void setCacheDir(const QString &newCacheDir);
+    bool isEnabled() const;
+
+    // Returns true and fills object and sourceHash if a valid cache entry exists for path
+    bool load(const QString &path, QJsonObject *object, QByteArray *sourceHash = nullptr);
+    void store(const QString &path, qint64 sourceSize, const QByteArray &sourceHash, const QJsonObject &object);
+
+    int hits() const;
+    int misses() const;
+    void resetCounters();
+
+    static QByteArray contentHash(const QByteArray &data);
+    static QByteArray encode(const QJsonObject &object);
+    static bool decode(const uchar *data, qint64 size, QJsonObject *object);
+
+private:
+    QString cacheFilePath(const QString &path) const;
+
+    QString m_cacheDir;
+    std::atomic<int> m_hits { 0 };
+    std::atomic<int> m_misses { 0 };
+};
@@ -0,0 +1,214 @@
+#include "layerjournal.h"
+
+#include <QDebug>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QStringList>
+
+#if defined(Q_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+void applyPath(QJsonObject &object, const QStringList &path, int index, const LayerJournal::Record &record) // NOLINT
+{
+    const QString &key = path.at(index);
+    if (index == path.size() - 1) {
+        if (record.reset) {
+            object.remove(key);
+        } else {
+            object.insert(key, record.value);
+        }
+        return;
+    }
+    QJsonObject child = object.value(key).toObject();
+    // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
+    applyPath(child, path, index + 1, record); // NOLINT
+    if (child.isEmpty()) {
+        object.remove(key);
+    } else {
+        object.insert(key, child);
+    }
+}
+
+bool syncHandle(int handle)
+{
+#if defined(Q_OS_WIN)
+    return _commit(handle) == 0;
+#else
+    return fsync(handle) == 0;
+#endif
+}
+
+}
+
+LayerJournal::LayerJournal(QString path)
+    : m_path(std::move(path)),
+      m_file(m_path)
+{
+}
+
+LayerJournal::~LayerJournal()
+{
+    sync();
+}
+
+const QString &LayerJournal::path() const
+{
+    return m_path;
+}
+
+bool LayerJournal::open()
+{
+    QMutexLocker locker(&m_mutex);
+    return openFile();
+}
+
+bool LayerJournal::openFile()
+{
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        qWarning().noquote() << "Failed to open journal" << m_path << m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    // terminate a record torn by a crash, so it doesn't damage the next one
+    if (m_size > 0 && m_file.seek(m_size - 1) && m_file.peek(1) != "\n") {
+        m_size += m_file.write("\n");
+        m_unsynced = true;
+    }
+    return true;
+}
+
+QVector<LayerJournal::Record> LayerJournal::records() const
+{
+    QVector<Record> ret;
+    QFile f(m_path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return ret;
+    }
+    while (!f.atEnd()) {
+        QByteArray line = f.readLine();
+        QJsonParseError error;
+        QJsonObject record = QJsonDocument::fromJson(line, &error).object();
+        if (error.error != QJsonParseError::NoError || !record.value("k").isString()) {
+            qWarning().noquote() << "Skipping a damaged record in journal" << m_path;
+            continue;
+        }
+        auto v = record.find("v");
+        ret.append({ record.value("k").toString(), v == record.end() ? QJsonValue() : v.value(), v == record.end() });
+    }
+    return ret;
+}
+
+void LayerJournal::append(const QString &key, const QJsonValue &value)
+{
+    write(QJsonObject { { "k", key }, { "v", value } });
+}
+
+void LayerJournal::appendReset(const QString &key)
+{
+    write(QJsonObject { { "k", key } });
+}
+
+bool LayerJournal::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    return !m_file.isOpen() || m_file.flush();
+}
+
+bool LayerJournal::sync()
+{
+    int handle = -1;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_unsynced || !m_file.isOpen()) {
+            return true;
+        }
+        m_unsynced = false;
+        if (!m_file.flush()) {
+            qWarning().noquote() << "Failed to flush journal" << m_path << m_file.errorString();
+            return false;
+        }
+        handle = m_file.handle();
+    }
+    // appends only go to the OS buffers meanwhile. The file is reopened only by truncate(), which is never
+    // called concurrently with sync()
+    if (!syncHandle(handle)) {
+        qWarning().noquote() << "Failed to sync journal" << m_path;
+        return false;
+    }
+    return true;
+}
+
+qint64 LayerJournal::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_size;
+}
+
+bool LayerJournal::truncate(qint64 offset)
+{
+    QMutexLocker locker(&m_mutex);
+    QByteArray tail;
+    if (m_file.isOpen() && m_file.flush()) {
+        QFile f(m_path);
+        if (f.open(QIODevice::ReadOnly) && f.seek(offset)) {
+            tail = f.readAll();
+        }
+    }
+    m_file.close();
+    // QSaveFile::commit syncs the new journal to storage before renaming it
+    QSaveFile f(m_path);
+    bool ok = f.open(QIODevice::WriteOnly) && f.write(tail) == tail.size() && f.commit();
+    if (!ok) {
+        qWarning().noquote() << "Failed to truncate journal" << m_path << f.errorString();
+    }
+    m_unsynced = false;
+    openFile();
+    return ok;
+}
+
+bool LayerJournal::isCompacting() const
+{
+    return m_compacting;
+}
+
+void LayerJournal::setCompacting(bool newCompacting)
+{
+    m_compacting = newCompacting;
+}
+
+void LayerJournal::setCompactionSize(qint64 newCompactionSize)
+{
+    m_compactionSize = newCompactionSize;
+}
+
+bool LayerJournal::needsCompaction() const
+{
+    return !m_compacting && size() > m_compactionSize;
+}
+
+void LayerJournal::apply(QJsonObject *object, const Record &record)
+{
+    const QStringList path = record.key.split('.');
+    if (path.size() > 64) {
+        return;
+    }
+    applyPath(*object, path, 0, record);
+}
+
+void LayerJournal::write(const QJsonObject &record)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return;
+    }
+    qint64 written = m_file.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+    if (written > 0) {
+        m_size += written;
+    }
+    m_unsynced = true;
+}
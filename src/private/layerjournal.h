@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QFile>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+// Append-only log of the changes made to a layer with setProperty and resetProperty. Each record is a line of
+// compact JSON: { "k": key, "v": value } sets a value, { "k": key } resets it. Records are appended as they are
+// made and synced to storage in batches. Replaying the log on top of the layer file restores the changes, and
+// compaction writes them into the layer file and drops the records it covers. Records are appended in the thread
+// owning the config, while sync() and truncate() may run on a worker thread, one at a time.
+class LayerJournal
+{
+public:
+    struct Record
+    {
+        QString key;
+        QJsonValue value;
+        bool reset = false;
+    };
+
+    explicit LayerJournal(QString path);
+    ~LayerJournal();
+
+    const QString &path() const;
+    // opens the journal for appending, creating it if needed
+    bool open();
+    // reads all records. A record torn by a crash while it was written is skipped
+    QVector<Record> records() const;
+    void append(const QString &key, const QJsonValue &value);
+    void appendReset(const QString &key);
+    // hands the appended records over to the OS, so records() reads them
+    bool flush();
+    // flushes the appended records and syncs them to storage
+    bool sync();
+    qint64 size() const;
+    // drops the records before offset, keeping the ones appended since
+    bool truncate(qint64 offset);
+
+    bool isCompacting() const;
+    void setCompacting(bool newCompacting);
+    // size in bytes past which the journal is compacted
+    void setCompactionSize(qint64 newCompactionSize);
+    bool needsCompaction() const;
+
+    // applies a record to a layer object, the key is a dot separated path
+    static void apply(QJsonObject *object, const Record &record);
+
+private:
+    bool openFile();
+    void write(const QJsonObject &record);
+
+    QString m_path;
+    // guards the file and its size
+    mutable QMutex m_mutex;
+    QFile m_file;
+    qint64 m_size = 0;
+    qint64 m_compactionSize = 64 * 1024;
+    bool m_unsynced = false;
+    bool m_compacting = false;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <QVector>
+
+#include <algorithm>
+#include <utility>
+
+// Compact map from layer priority to value, kept as a vector sorted by priority. A property is usually
+// overridden by a few layers only, so a flat vector is both smaller and faster than a QMap, and the
+// effective (topmost) value is always the last entry.
+template<typename T>
+class LayerMap
+{
+public:
+    using Entry = std::pair<int, T>;
+
+    bool isEmpty() const { return m_entries.isEmpty(); }
+    bool empty() const { return m_entries.isEmpty(); }
+    int size() const { return int(m_entries.size()); }
+    bool contains(int level) const { return find(level) != nullptr; }
+
+    const T *find(int level) const
+    {
+        auto it = lowerBound(level);
+        if (it == m_entries.cend() || it->first != level) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    T value(int level, const T &defaultValue = T()) const
+    {
+        const T *v = find(level);
+        return v ? *v : defaultValue;
+    }
+
+    T &operator[](int level)
+    {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), level, &LayerMap::entryLess);
+        if (it == m_entries.end() || it->first != level) {
+            it = m_entries.insert(it, Entry(level, T()));
+        }
+        return it->second;
+    }
+
+    void insert(int level, T value) { (*this)[level] = std::move(value); }
+
+    bool remove(int level)
+    {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), level, &LayerMap::entryLess);
+        if (it == m_entries.end() || it->first != level) {
+            return false;
+        }
+        m_entries.erase(it);
+        return true;
+    }
+
+    // moves the value from one level to another, overwriting the existing one. Returns false if there is no value at from
+    bool move(int from, int to)
+    {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), from, &LayerMap::entryLess);
+        if (it == m_entries.end() || it->first != from) {
+            return false;
+        }
+        T v = std::move(it->second);
+        m_entries.erase(it);
+        (*this)[to] = std::move(v);
+        return true;
+    }
+
+    const T &last() const { return m_entries.last().second; }
+    T &last() { return m_entries.last().second; }
+    int lastKey() const { return m_entries.last().first; }
+
+    typename QVector<Entry>::const_iterator begin() const { return m_entries.cbegin(); }
+    typename QVector<Entry>::const_iterator end() const { return m_entries.cend(); }
+
+private:
+    static bool entryLess(const Entry &e, int level) { return e.first < level; }
+
+    typename QVector<Entry>::const_iterator lowerBound(int level) const
+    {
+        return std::lower_bound(m_entries.cbegin(), m_entries.cend(), level, &LayerMap::entryLess);
+    }
+
+    QVector<Entry> m_entries;
+};
@@ -0,0 +1,65 @@
+#include "metaobjectcache.h"
+
+#include <QDebug>
+#include <QMetaObject>
+#include <QMutexLocker>
+
+#include <cstdlib>
+
+MetaObjectCache &MetaObjectCache::instance()
+{
+    static MetaObjectCache cache;
+    return cache;
+}
+
+QMetaObject *MetaObjectCache::acquire(const QByteArray &shape)
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_entries.find(shape);
+    if (it == m_entries.end()) {
+        return nullptr;
+    }
+    ++it->refCount;
+    return it->metaObject;
+}
+
+QMetaObject *MetaObjectCache::insert(const QByteArray &shape, QMetaObject *metaObject)
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = m_entries.find(shape);
+    if (it != m_entries.end()) {
+        // metaobjects are created using malloc/memset by QMetaObjectBuilder, hence NOLINT
+        free(metaObject); // NOLINT
+        ++it->refCount;
+        return it->metaObject;
+    }
+    m_entries.insert(shape, Entry { metaObject, 1 });
+    m_shapes.insert(metaObject, shape);
+    return metaObject;
+}
+
+void MetaObjectCache::release(const QMetaObject *metaObject)
+{
+    if (!metaObject) {
+        return;
+    }
+    QMutexLocker lock(&m_mutex);
+    auto shapeIt = m_shapes.find(metaObject);
+    if (shapeIt == m_shapes.end()) {
+        qWarning() << "Releasing unknown metaobject" << metaObject->className();
+        return;
+    }
+    auto it = m_entries.find(shapeIt.value());
+    if (--it->refCount > 0) {
+        return;
+    }
+    free(it->metaObject); // NOLINT
+    m_entries.erase(it);
+    m_shapes.erase(shapeIt);
+}
+
+int MetaObjectCache::size() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_entries.size();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+struct QMetaObject;
+
+// Process-wide cache of generated metaobjects. Nodes having the same shape (property names and types,
+// child names and writability) share one immutable metaobject, which is freed when the last object using
+// it is destroyed.
+class MetaObjectCache
+{
+public:
+    static MetaObjectCache &instance();
+
+    // returns the metaobject for the shape with its reference count incremented, or nullptr if not cached
+    QMetaObject *acquire(const QByteArray &shape);
+    // takes ownership of the metaobject built by QMetaObjectBuilder. If another one was inserted for the same
+    // shape meanwhile, the passed one is freed and the cached one is returned instead
+    QMetaObject *insert(const QByteArray &shape, QMetaObject *metaObject);
+    void release(const QMetaObject *metaObject);
+
+    int size() const;
+
+private:
+    MetaObjectCache() = default;
+
+    struct Entry
+    {
+        QMetaObject *metaObject = nullptr;
+        int refCount = 0;
+    };
+
+    mutable QMutex m_mutex;
+    QHash<QByteArray, Entry> m_entries;
+    QHash<const QMetaObject*, QByteArray> m_shapes;
+};
@@ -4,8 +4,11 @@
 
 #include "jsonconfig.h"
 #include "JsonQObject.h"
+#include "metaobjectcache.h"
 #include <QScopeGuard>
 
+#include <atomic>
+
 static constexpr const int MAX_RECURSION_DEPTH = 10;
 
 #define LIMIT_RECURSION_DEPTH(maxDepth) /* NOLINT(cppcoreguidelines-macro-usage) */                              \
@@ -24,9 +27,52 @@ static constexpr const int MAX_RECURSION_DEPTH = 10;
         return returnValue;                                                                                      \
     }                                                                                                            \
 
+namespace {
+
+// returns the name of the property type used in generated metaobjects, or empty name if the type is not supported
+QByteArray propertyTypeName(const QString &key, const QVariant &value)
+{
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    switch (value.type()) {
+    case QVariant::Bool:
+        return "bool";
+    case QVariant::Double:
+        return "double";
+    case QVariant::String:
+        return "QString";
+    case QVariant::List:
+        return "QVariantList";
+    case QVariant::LongLong:
+        return "qlonglong";
+    default:
+        qWarning() << "Unsupported property type" << key << value.type();
+        return {};
+    }
+#else
+    switch (value.typeId()) {
+    case QMetaType::Bool:
+        return "bool";
+    case QMetaType::Double:
+        return "double";
+    case QMetaType::QString:
+        return "QString";
+    case QMetaType::QVariantList:
+        return "QVariantList";
+    case QMetaType::LongLong:
+        return "qlonglong";
+    default:
+        qWarning() << "Unsupported property type" << key << value.typeName();
+        return {};
+    }
+#endif
+}
+
+}
 
 Node::NamedMultiValue::NamedMultiValue(QString key, QVariant value)
-    : key(std::move(key))
+    : key(std::move(key)),
+      kind(kindOf(value)),
+      generation(nextGeneration())
 {
     values[0] = std::move(value);
 }
@@ -46,15 +92,12 @@ int Node::NamedMultiValue::setValue(const QVariant &value)
     if (values.isEmpty()) {
         return -1;
     }
-    auto it = values.end();
-    --it;
-    if (it.value() != value && !refs.isEmpty()) {
-        auto refIt = refs.end();
-        --refIt;
-        refs.remove(refIt.key());
+    if (values.last() != value && !refs.isEmpty()) {
+        refs.remove(refs.lastKey());
     }
-    it.value() = value;
-    return it.key();
+    values.last() = value;
+    bumpGeneration();
+    return values.lastKey();
 }
 
 void Node::NamedMultiValue::writeValue(const QVariant &value, int level)
@@ -62,51 +105,74 @@ void Node::NamedMultiValue::writeValue(const QVariant &value, int level)
     values[level] = value;
 }
 
+Node::NamedMultiValue::Kind Node::NamedMultiValue::kindOf(const QVariant &value)
+{
+    switch (value.userType()) {
+    case QMetaType::Bool:
+        return Bool;
+    case QMetaType::Double:
+    case QMetaType::Float:
+        return Double;
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+        return Integer;
+    case QMetaType::QString:
+        return String;
+    case QMetaType::QVariantList:
+        return List;
+    default:
+        return Other;
+    }
+}
+
+// metatype of the values stored for a kind
+int Node::NamedMultiValue::storageType(Kind kind)
+{
+    switch (kind) {
+    case Bool:
+        return QMetaType::Bool;
+    case Double:
+        return QMetaType::Double;
+    case Integer:
+        return QMetaType::LongLong;
+    case String:
+        return QMetaType::QString;
+    case List:
+        return QMetaType::QVariantList;
+    case Other:
+        break;
+    }
+    return QMetaType::UnknownType;
+}
+
 void Node::NamedMultiValue::changePriority(int oldPrio, int newPrio)
 {
     if (changeValuePriority(oldPrio, newPrio)) {
         changeRefPriority(oldPrio, newPrio);
+        if (emitPending) {
+            bumpGeneration();
+        }
     }
 }
 
 bool Node::NamedMultiValue::changeValuePriority(int oldPrio, int newPrio)
 {
-    if (oldPrio == newPrio) {
+    if (oldPrio == newPrio || values.isEmpty()) {
         return false;
     }
     emitPending = newPrio >= values.lastKey() || oldPrio == values.lastKey();
-    auto it = values.find(oldPrio);
-    if (it == values.end() ) {
-        return false;
-    }
-    auto it2 = values.find(newPrio);
-
-    QVariant val = it.value();
-    if (it2 != values.end()) {
-        it2.value() = val;
-    } else {
-        values.insert(newPrio, val);
-    }
-    values.erase(it);
-    return true;
+    return values.move(oldPrio, newPrio);
 }
 
 bool Node::NamedMultiValue::changeRefPriority(int oldPrio, int newPrio)
 {
-    auto it = refs.find(oldPrio);
-    if (it == refs.end() ) {
-        return false;
-    }
-    auto it2 = refs.find(newPrio);
-
-    QString val = it.value();
-    if (it2 != refs.end()) {
-        it2.value() = val;
-    } else {
-        refs.insert(newPrio, val);
-    }
-    refs.erase(it);
-    return true;
+    return refs.move(oldPrio, newPrio);
 }
 
 bool Node::NamedMultiValue::isRef(int level) const
@@ -124,6 +190,17 @@ const QString &Node::NamedMultiValue::ref() const
     return refs.last();
 }
 
+void Node::NamedMultiValue::bumpGeneration()
+{
+    generation = nextGeneration();
+}
+
+quint64 Node::nextGeneration()
+{
+    static std::atomic<quint64> counter { 0 };
+    return ++counter;
+}
+
 void Node::createObject()
 {
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
@@ -143,97 +220,107 @@ void Node::createObject()
         m_object->blockSignals(false);
         m_config->userObjectCreated(this, m_object);
     } else {
-        QMetaObjectBuilder b;
-        QStringList classNameParts;
-        Node *p = m_parent;
-        if (!m_name.isEmpty()) {
-            classNameParts.append(m_name);
-            classNameParts.last()[0] = classNameParts.last()[0].toUpper();
-        }
-        while (p) {
-            classNameParts.prepend(m_parent->m_name);
-            classNameParts.first()[0] = classNameParts.first()[0].toUpper();
-            p = p->m_parent;
-        }
-        if (!classNameParts.isEmpty()) {
-            b.setClassName(classNameParts.join("").toLatin1());
-        } else {
-            b.setClassName("RootObject");
-        }
-        b.setSuperClass(&QObject::staticMetaObject);
-
-        // add POD properties first
+        QList<QByteArray> types;
+        types.reserve(properties.size());
+        // shape signature: writability, property names with types and child names. Names are UTF-8 with their
+        // length in front, so keys with any characters, separators included, can't make two shapes alike
+        QByteArray shape = m_config->readonly() ? "r" : "w";
+        auto appendName = [&shape](const QString &name) {
+            QByteArray utf8 = name.toUtf8();
+            shape += QByteArray::number(utf8.size()) + ':' + utf8;
+        };
         for (auto &p : properties) {
-            QByteArray type;
-    #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-            switch (p.values[0].type()) {
-            case QVariant::Bool:
-                type = "bool";
-                break;
-            case QVariant::Double:
-                type = "double";
-                break;
-            case QVariant::String:
-                type = "QString";
-                break;
-            case QVariant::List:
-                type = "QVariantList";
-                break;
-            case QVariant::LongLong:
-                type = "qlonglong";
-                break;
-            default:
-                qWarning() << "Unsupported property type" << p.key << p.values[0].type();
-                continue;
-            }
-    #else
-            switch (p.values[0].typeId()) {
-            case QMetaType::Bool:
-                type = "bool";
-                break;
-            case QMetaType::Double:
-                type = "double";
-                break;
-            case QMetaType::QString:
-                type = "QString";
-                break;
-            case QMetaType::QVariantList:
-                type = "QVariantList";
-                break;
-            case QMetaType::LongLong:
-                type = "qlonglong";
-                break;
-            default:
-                qWarning() << "Unsupported property type" << p.key << p.values[0].typeName();
-                continue;
-            }
-    #endif
-            QByteArray pname = p.key.toLatin1();
-            QMetaPropertyBuilder pb = b.addProperty(pname, type);
-            pb.setStdCppSet(false);
-            pb.setWritable(!m_config->readonly());
-            QByteArray sig(pname + "Changed()");
-            QMetaMethodBuilder mb = b.addSignal(sig);
-            mb.setReturnType("void");
-            pb.setNotifySignal(mb);
+            p.kind = NamedMultiValue::kindOf(p.values.value(0));
+            types.append(propertyTypeName(p.key, p.values.value(0)));
+            appendName(p.key);
+            shape += types.last() + ';';
         }
-
+        shape += '|';
         for (auto &cn : m_childNodes) {
-            QByteArray pname = cn->m_name.toLatin1();
-            QMetaPropertyBuilder pb = b.addProperty(pname, "QObject*");
-            QByteArray sig(pname + "Changed()");
-            QMetaMethodBuilder mb = b.addSignal(sig);
-            mb.setReturnType("void");
-            pb.setNotifySignal(mb);
-        }
-        QMetaObject *mo = b.toMetaObject();
+            appendName(cn->m_name);
+        }
+
+        QMetaObject *mo = MetaObjectCache::instance().acquire(shape);
+        if (!mo) {
+            mo = MetaObjectCache::instance().insert(shape, buildMetaObject(types));
+            m_config->m_stats->countMetaObject();
+        }
         if (m_object) {
             m_object->deleteLater();
         }
 
-        m_object = new JsonQObject(mo, this, m_parent ? static_cast<QObject*>(m_parent->m_object) : m_config);
+        m_object = new JsonQObject(mo, this, m_parent ? m_parent->object() : static_cast<QObject*>(m_config));
+        for (int i = 0; i < properties.size(); ++i) {
+            cacheNotifySignal(properties[i], i + mo->propertyOffset());
+        }
+    }
+}
+
+// resolves the notify signal of the property once, so notifications don't have to look it up
+void Node::cacheNotifySignal(NamedMultiValue &p, int metaPropertyIndex)
+{
+    const QMetaObject *mo = m_object->metaObject();
+    p.notifyMetaObject = nullptr;
+    p.notifySignalIndex = -1;
+    if (metaPropertyIndex >= mo->propertyCount()) {
+        return;
+    }
+    int sig_id = mo->property(metaPropertyIndex).notifySignalIndex();
+    if (sig_id == -1) {
+        return;
+    }
+    while (sig_id < mo->methodOffset()) {
+        mo = mo->superClass();
+    }
+    p.notifyMetaObject = mo;
+    p.notifySignalIndex = sig_id - mo->methodOffset();
+}
+
+QMetaObject *Node::buildMetaObject(const QList<QByteArray> &types) const
+{
+    QMetaObjectBuilder b;
+    QStringList classNameParts;
+    Node *p = m_parent;
+    if (!m_name.isEmpty()) {
+        classNameParts.append(m_name);
+        classNameParts.last()[0] = classNameParts.last()[0].toUpper();
     }
+    while (p) {
+        classNameParts.prepend(m_parent->m_name);
+        classNameParts.first()[0] = classNameParts.first()[0].toUpper();
+        p = p->m_parent;
+    }
+    if (!classNameParts.isEmpty()) {
+        b.setClassName(classNameParts.join("").toLatin1());
+    } else {
+        b.setClassName("RootObject");
+    }
+    b.setSuperClass(&QObject::staticMetaObject);
 
+    // add POD properties first
+    for (int i = 0; i < properties.size(); ++i) {
+        if (types[i].isEmpty()) {
+            continue;
+        }
+        QByteArray pname = properties[i].key.toLatin1();
+        QMetaPropertyBuilder pb = b.addProperty(pname, types[i]);
+        pb.setStdCppSet(false);
+        pb.setWritable(!m_config->readonly());
+        QByteArray sig(pname + "Changed()");
+        QMetaMethodBuilder mb = b.addSignal(sig);
+        mb.setReturnType("void");
+        pb.setNotifySignal(mb);
+    }
+
+    for (auto &cn : m_childNodes) {
+        QByteArray pname = cn->m_name.toLatin1();
+        QMetaPropertyBuilder pb = b.addProperty(pname, "QObject*");
+        QByteArray sig(pname + "Changed()");
+        QMetaMethodBuilder mb = b.addSignal(sig);
+        mb.setReturnType("void");
+        pb.setNotifySignal(mb);
+    }
+    return b.toMetaObject();
 }
 
 const QString &Node::name() const
@@ -245,11 +332,29 @@ bool Node::moveLayer(int oldPriority, int newPriority) // NOLINT
 {
     LIMIT_RECURSION_DEPTH_RET(MAX_RECURSION_DEPTH, false);
     bool changed = false;
-    for (auto & p : properties) {
+    for (int i = 0; i < properties.size(); ++i) {
+        auto &p = properties[i];
+        bool wasPending = p.emitPending;
+        // refs move to other levels with their layers
+        for (const auto &r : p.refs) {
+            m_config->m_refGraph.removeRef(this, i, r.first);
+        }
         p.changePriority(oldPriority, newPriority);
+        for (const auto &r : p.refs) {
+            m_config->m_refGraph.addRef(this, i, r.first, r.second);
+        }
         changed |= p.emitPending;
+        if (p.emitPending && !wasPending) {
+            m_config->m_dirtyProperties.append({ this, i });
+        }
+        if (p.emitPending) {
+            m_config->m_refGraph.propertyChanged(this, i);
+        }
     }
     for (auto n : qAsConst(m_childNodes)) {
+        if (n->m_lazy) {
+            continue;
+        }
         // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
         changed |= n->moveLayer(oldPriority, newPriority); // NOLINT
     }
@@ -259,37 +364,51 @@ bool Node::moveLayer(int oldPriority, int newPriority) // NOLINT
 void Node::setJsonObject(QJsonObject object) // NOLINT
 {
     LIMIT_RECURSION_DEPTH(MAX_RECURSION_DEPTH);
+    markSnapshotDirty();
     // split primitive propertties and Object properties
     m_cachedJsonObject = &object;
     QMap<QString, QJsonObject> objects;
+    properties.reserve(object.size());
     for (auto it = object.begin(); it != object.end(); ++it) {
         if (!it.value().isObject()) {
             if (it.key().startsWith('$')) {
                 handleSpecialProperty(it.key(), it.value().toString());
             } else {
-                properties.append(NamedMultiValue(it.key(), it.value().toVariant()));
+                properties.append(NamedMultiValue(m_config->m_strings.intern(it.key()), m_config->m_strings.variant(it.value())));
             }
         } else if (isRefObject(it.value().toObject())) {
             auto ref = getRefValue(it.value().toObject());
-            NamedMultiValue p{it.key(), resolvedRef(resolvedRefPath(ref))};
+            NamedMultiValue p{m_config->m_strings.intern(it.key()), resolvedRef(resolvedRefPath(ref))};
             p.refs[0] = ref;
+            m_config->m_refGraph.invalidate();
             properties.append(p);
         } else {
             objects[it.key()] = it.value().toObject();
         }
     }
+    bool lazy = m_config->lazyLoading();
+    m_childNodes.reserve(objects.size());
     for (auto it = objects.begin(); it != objects.end(); ++it) {
-        Node *n = new Node();
+        Node *n = m_config->m_nodes.create();
         n->m_config = m_config;
-        n->m_name = it.key();
+        n->m_name = m_config->m_strings.intern(it.key());
         n->m_root = m_root ? m_root : this;
-        m_childNodes.append(NodePtr(n));
+        n->m_parent = this;
+        m_childNodes.append(n);
+        if (lazy) {
+            n->m_lazy = true;
+            n->m_pendingObject = it.value();
+            continue;
+        }
         // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
         n->setJsonObject(it.value()); // NOLINT
-        n->m_parent = this;
     }
-    createObject();
+    buildKeyIndex();
+    m_loaded = true;
     m_cachedJsonObject = nullptr;
+    if (!m_root) {
+        m_refMemo.clear();
+    }
 }
 
 QJsonObject Node::toJsonObject(int level) const // NOLINT
@@ -316,7 +435,7 @@ QJsonObject Node::toJsonObject(int level) const // NOLINT
     }
     for (const auto & n : m_childNodes) {
         // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
-        QJsonObject obj = n->toJsonObject(level); // NOLINT
+        QJsonObject obj = n->m_lazy ? n->lazyJsonObject(level) : n->toJsonObject(level); // NOLINT
         if (!obj.isEmpty()) {
             ret[n->m_name] = obj;
         }
@@ -324,6 +443,34 @@ QJsonObject Node::toJsonObject(int level) const // NOLINT
     return ret;
 }
 
+// captures the values of a layer for writing, sharing the stored values instead of converting them to JSON
+LayerTree Node::layerTree(int level) const // NOLINT
+{
+    LIMIT_RECURSION_DEPTH_RET(MAX_RECURSION_DEPTH, {});
+    LayerTree ret;
+    ret.name = m_name;
+    for (const auto &g : properties) {
+        const QVariant *v = g.values.find(level);
+        if (v && v->isValid()) {
+            ret.values.push_back({ g.key, *v, g.isRef(level) ? g.refs.value(level) : QString() });
+        }
+    }
+    for (const auto *n : m_childNodes) {
+        LayerTree child;
+        if (n->m_lazy) {
+            child.name = n->m_name;
+            child.json = n->lazyJsonObject(level);
+        } else {
+            // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
+            child = n->layerTree(level); // NOLINT
+        }
+        if (!child.isEmpty()) {
+            ret.children.push_back(std::move(child));
+        }
+    }
+    return ret;
+}
+
 // swap JSON object for nodes when layer file is changed
 void Node::swapJsonObject(QJsonObject oldObject, QJsonObject newObject, int level) // NOLINT
 {
@@ -333,11 +480,16 @@ void Node::swapJsonObject(QJsonObject oldObject, QJsonObject newObject, int leve
         auto it_old = oldObject.find(properties[i].key);
         auto it_new = newObject.find(properties[i].key);
         if (it_new != newObject.end()) {
-            if (it_new->isObject()) {
+            if (it_new->isObject() && isRefObject(it_new->toObject())) {
+                auto ref = getRefValue(it_new->toObject());
+                updateProperty(i, level, m_config->m_refGraph.value(ref));
+                properties[i].refs[level] = ref;
+                m_config->m_refGraph.addRef(this, i, level, ref);
+            } else if (it_new->isObject()) {
                 qWarning() << "Property" << it_new.key() << "has different type in the layer (Object)";
                 removeProperty(i, level);
             } else {
-                updateProperty(i, level, it_new.value().toVariant());
+                updateProperty(i, level, m_config->m_strings.variant(it_new.value()));
             }
             newObject.erase(it_new);
         } else if (it_old != oldObject.end()) {
@@ -349,8 +501,15 @@ void Node::swapJsonObject(QJsonObject oldObject, QJsonObject newObject, int leve
     for (auto n : qAsConst(m_childNodes)) {
         auto it = newObject.find(n->name());
         if (it != newObject.end()) {
-            // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
-            n->swapJsonObject(oldObject.value(n->name()).toObject(), it->toObject(), level); // NOLINT
+            if (n->m_lazy) {
+                // values of the other layers are read when the node is built
+                if (level == 0) {
+                    n->m_pendingObject = it->toObject();
+                }
+            } else {
+                // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
+                n->swapJsonObject(oldObject.value(n->name()).toObject(), it->toObject(), level); // NOLINT
+            }
             it = newObject.erase(it);
         }
     }
@@ -368,29 +527,28 @@ void Node::swapJsonObject(QJsonObject oldObject, QJsonObject newObject, int leve
 void Node::updateJsonObject(QJsonObject object, int level) // NOLINT
 {
     LIMIT_RECURSION_DEPTH(MAX_RECURSION_DEPTH);
-    m_cachedJsonObject = &object;
     QMap<QString, QJsonObject> objects;
 
     auto getPropertyIndex = [this](const QString & key) -> int {
-        auto ii = std::find_if(properties.begin(), properties.end(), [&](const NamedMultiValue &v) { return v.key == key;});
-        if (ii == properties.end()) {
+        int id = indexOfProperty(key);
+        if (id == -1) {
             qWarning().noquote() << "Property" << fullPropertyName(key) << "does not exist in base config";
-            return -1;
         }
-        return std::distance(properties.begin(), ii);
+        return id;
     };
     for (auto it = object.begin(); it != object.end(); ++it) {
         if (!it.value().isObject()) {
             if (!it.key().startsWith('$')) {
                 if (int id = getPropertyIndex(it.key()); id > -1) {
-                    updateProperty(id, level, it.value().toVariant());
+                    updateProperty(id, level, m_config->m_strings.variant(it.value()));
                 }
             }
         } else if (isRefObject(it.value().toObject())) {
             if (int id = getPropertyIndex(it.key()); id > -1) {
                 auto ref = getRefValue(it.value().toObject());
-                updateProperty(id, level, resolvedRef(resolvedRefPath(ref)));
+                updateProperty(id, level, m_config->m_refGraph.value(ref));
                 properties[id].refs[level] = ref;
+                m_config->m_refGraph.addRef(this, id, level, ref);
             }
         } else {
             objects[it.key()] = it.value().toObject();
@@ -398,37 +556,32 @@ void Node::updateJsonObject(QJsonObject object, int level) // NOLINT
     }
     for (auto it = objects.begin(); it != objects.end(); ++it) {
         if (!it.key().startsWith('$')) {
-            auto ii = std::find_if(m_childNodes.begin(), m_childNodes.end(), [&](const NodePtr &node) { return node->m_name == it.key();});
-            if (ii == m_childNodes.end()) {
+            int childIdx = indexOfChild(it.key());
+            if (childIdx == -1) {
                 qWarning().noquote() << "Property" << fullPropertyName(it.key()) << "does not exist in base config";
                 continue;
             }
+            if (m_childNodes[childIdx]->m_lazy) {
+                continue;
+            }
             // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
-            (*ii)->updateJsonObject(it.value(), level); // NOLINT
+            m_childNodes[childIdx]->updateJsonObject(it.value(), level); // NOLINT
         }
     }
-    m_cachedJsonObject = nullptr;
 }
 
 bool Node::updateProperty(int index, int level, const QVariant &value)
 {
     QVariant oldValue = valueAt(index);
     auto &p = properties[index];
-    p.values[level] = value;
+    p.writeValue(value, level);
 
     if (oldValue != valueAt(index)) {
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-        if (typeHint != QMetaType::UnknownType && p.userTypePropertyIndex != -1) {
-#else
-        if (typeHint.isValid() && p.userTypePropertyIndex != -1) {
-#endif
-            const auto *mo = m_object->metaObject();
-            QMetaProperty mp = mo->property(p.userTypePropertyIndex);
-            m_object->blockSignals(true);
-            mp.write(m_object, value);
-            m_object->blockSignals(false);
+        writeUserObjectProperty(index);
+        if (p.refs.remove(level)) {
+            m_config->m_refGraph.removeRef(this, index, level);
         }
-        p.refs.remove(level);
+        p.bumpGeneration();
         propertyChangedHelper(index);
         return true;
     }
@@ -440,21 +593,152 @@ void Node::removeProperty(int index, int level)
     auto &p = properties[index];
     auto oldValue = valueAt(index);
     p.values.remove(level);
-    p.refs.remove(level);
+    if (p.refs.remove(level)) {
+        m_config->m_refGraph.removeRef(this, index, level);
+    }
     auto newValue = valueAt(index);
     if (oldValue != newValue) {
+        writeUserObjectProperty(index);
+        p.bumpGeneration();
+        propertyChangedHelper(index);
+    }
+}
+
+// builds a lazily loaded node from its part of the root config, then applies the values of the active layers
+void Node::materialize()
+{
+    if (!m_lazy) {
+        return;
+    }
+    // reset first, resolving the refs below may lead back to this node
+    m_lazy = false;
+    setJsonObject(std::move(m_pendingObject));
+    m_pendingObject = QJsonObject();
+    for (auto &p : properties) {
+        if (!p.refs.isEmpty()) {
+            // the root config is not at hand anymore, refs take the current value of their target
+            p.writeValue(m_config->m_refGraph.value(p.refs.value(0)), 0);
+        }
+    }
+    const auto patches = m_config->activeLayerObjects(path());
+    for (const auto &patch : patches) {
+        for (auto it = patch.object.begin(); it != patch.object.end(); ++it) {
+            int index = indexOfProperty(it.key());
+            if (index != -1) {
+                writeLayerValue(index, patch.level, it.value());
+            }
+        }
+    }
+}
+
+// keys from the root object down to this node
+QStringList Node::path() const
+{
+    QStringList ret;
+    for (const Node *n = this; n->m_parent; n = n->m_parent) {
+        ret.prepend(n->m_name);
+    }
+    return ret;
+}
+
+// values of a node not built yet: its part of the root config, or of the layer if the layer is active
+QJsonObject Node::lazyJsonObject(int level) const
+{
+    if (level <= 0) {
+        return m_pendingObject;
+    }
+    return m_config->layerObject(level, path());
+}
+
+// stores the value of a layer object key, either a plain value or a ref
+void Node::writeLayerValue(int index, int level, const QJsonValue &value)
+{
+    auto &p = properties[index];
+    if (!value.isObject()) {
+        p.writeValue(m_config->m_strings.variant(value), level);
+        if (p.refs.remove(level)) {
+            m_config->m_refGraph.removeRef(this, index, level);
+        }
+    } else if (isRefObject(value.toObject())) {
+        auto ref = getRefValue(value.toObject());
+        p.writeValue(m_config->m_refGraph.value(ref), level);
+        p.refs[level] = ref;
+        m_config->m_refGraph.addRef(this, index, level, ref);
+    }
+}
+
+// writes the effective value to the property of the user type object, if the node has one
+void Node::writeUserObjectProperty(int index)
+{
+    auto &p = properties[index];
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-        if (typeHint != QMetaType::UnknownType && p.userTypePropertyIndex != -1) {
+    if (typeHint != QMetaType::UnknownType && p.userTypePropertyIndex != -1) {
 #else
-        if (typeHint.isValid() && p.userTypePropertyIndex != -1) {
+    if (typeHint.isValid() && p.userTypePropertyIndex != -1) {
 #endif
-            const auto *mo = m_object->metaObject();
-            QMetaProperty mp = mo->property(p.userTypePropertyIndex);
-            m_object->blockSignals(true);
-            mp.write(m_object, newValue);
-            m_object->blockSignals(false);
+        const auto *mo = m_object->metaObject();
+        QMetaProperty mp = mo->property(p.userTypePropertyIndex);
+        m_object->blockSignals(true);
+        mp.write(m_object, p.value());
+        m_object->blockSignals(false);
+    }
+}
+
+// applies several layer changes in one pass: values of deactivated levels are dropped, values of activated
+// layers are written, and each property is compared and notified at most once
+void Node::applyLayers(const QList<LayerPatch> &activated, const QList<int> &deactivated) // NOLINT
+{
+    LIMIT_RECURSION_DEPTH(MAX_RECURSION_DEPTH);
+    if (activated.isEmpty() && deactivated.isEmpty()) {
+        return;
+    }
+    for (const auto &patch : activated) {
+        for (auto it = patch.object.begin(); it != patch.object.end(); ++it) {
+            if (it.key().startsWith('$')) {
+                continue;
+            }
+            bool isChild = it.value().isObject() && !isRefObject(it.value().toObject());
+            if ((isChild ? indexOfChild(it.key()) : indexOfProperty(it.key())) == -1) {
+                qWarning().noquote() << "Property" << fullPropertyName(it.key()) << "does not exist in base config";
+            }
         }
-        propertyChangedHelper(index);
+    }
+
+    for (int i = 0; i < properties.size(); ++i) {
+        auto &p = properties[i];
+        QVariant oldValue = p.value();
+        for (int level : deactivated) {
+            p.values.remove(level);
+            if (p.refs.remove(level)) {
+                m_config->m_refGraph.removeRef(this, i, level);
+            }
+        }
+        for (const auto &patch : activated) {
+            auto it = patch.object.constFind(p.key);
+            if (it != patch.object.constEnd()) {
+                writeLayerValue(i, patch.level, it.value());
+            }
+        }
+        if (oldValue != p.value()) {
+            writeUserObjectProperty(i);
+            p.bumpGeneration();
+            propertyChangedHelper(i);
+        }
+    }
+
+    for (auto &child : m_childNodes) {
+        if (child->m_lazy) {
+            continue;
+        }
+        QList<LayerPatch> childPatches;
+        for (const auto &patch : activated) {
+            auto it = patch.object.constFind(child->m_name);
+            if (it != patch.object.constEnd() && it.value().isObject()) {
+                childPatches.append({ patch.level, it.value().toObject() });
+            }
+        }
+        // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
+        child->applyLayers(childPatches, deactivated); // NOLINT
     }
 }
 
@@ -467,7 +751,12 @@ void Node::clear() // NOLINT
     }
 
     properties.clear();
+    m_propertyIndex.clear();
+    m_childIndex.clear();
     m_name.clear();
+    m_loaded = false;
+    m_snapshot.reset();
+    markSnapshotDirty();
     for (auto &child : m_childNodes) {
         // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
         child->clear(); // NOLINT
@@ -482,41 +771,36 @@ void Node::unload(int level) // NOLINT
         removeProperty(i, level);
     }
     for (auto &n : m_childNodes) {
+        if (n->m_lazy) {
+            continue;
+        }
         // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
         n->unload(level); // NOLINT
     }
 }
 
-void Node::emitDeferredSignals() // NOLINT
+int Node::indexOfProperty(const QString &name) const
 {
-    LIMIT_RECURSION_DEPTH(MAX_RECURSION_DEPTH);
-    for (qsizetype i = 0; i < properties.size(); ++i) {
-        if (properties[i].emitPending) {
-            notifyPropertyUpdate(i);
-        }
-    }
-    for (auto n : qAsConst(m_childNodes)) {
-        // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
-        n->emitDeferredSignals(); // NOLINT
-    }
+    return m_propertyIndex.value(name, -1);
 }
 
-int Node::indexOfProperty(const QString &name) const
+int Node::indexOfChild(const QString &name) const
 {
-    auto it = std::find_if(properties.begin(), properties.end(), [&](const NamedMultiValue &grp) { return grp.key == name; });
-    if (it == properties.end()) {
-        return -1;
-    }
-    return int(std::distance(properties.begin(), it));
+    return m_childIndex.value(name, -1);
 }
 
-int Node::indexOfChild(const QString &name) const
+void Node::buildKeyIndex()
 {
-    auto it = std::find_if(m_childNodes.begin(), m_childNodes.end(), [&](const NodePtr &n) { return n->m_name == name; });
-    if (it == m_childNodes.end()) {
-        return -1;
+    m_propertyIndex.clear();
+    m_propertyIndex.reserve(properties.size());
+    for (int i = 0; i < properties.size(); ++i) {
+        m_propertyIndex.insert(properties[i].key, i);
+    }
+    m_childIndex.clear();
+    m_childIndex.reserve(m_childNodes.size());
+    for (int i = 0; i < m_childNodes.size(); ++i) {
+        m_childIndex.insert(m_childNodes[i]->m_name, i);
     }
-    return int(std::distance(m_childNodes.begin(), it));
 }
 
 QString Node::fullPropertyName(const QString &property) const
@@ -540,18 +824,66 @@ void Node::setConfig(JsonConfig *newConfig)
 
 void Node::propertyChangedHelper(int index)
 {
+    m_config->m_stats->countPropertyWrite();
+    m_config->m_refGraph.propertyChanged(this, index);
     if (m_config->deferChangeSignals()) {
-        properties[index].emitPending = true;
+        auto &p = properties[index];
+        if (!p.emitPending) {
+            p.emitPending = true;
+            m_config->m_dirtyProperties.append({ this, index });
+        }
     } else {
         notifyPropertyUpdate(index);
+        m_config->m_refGraph.propagate();
     }
 }
 
+// sets the values of ref entries recomputed from their targets
+bool Node::updateRefValues(int index, const QVector<QPair<int, QVariant>> &values)
+{
+    auto &p = properties[index];
+    QVariant oldValue = p.value();
+    for (const auto &v : values) {
+        p.writeValue(v.second, v.first);
+    }
+    if (oldValue == p.value()) {
+        return false;
+    }
+    writeUserObjectProperty(index);
+    p.bumpGeneration();
+    propertyChangedHelper(index);
+    return true;
+}
+
+// stores a value the user type object changed itself. It's not notified, the object has emitted its own signal
+void Node::setUserObjectValue(int index, const QVariant &value)
+{
+    properties[index].setValue(value);
+    markSnapshotDirty();
+    m_config->scheduleSnapshot();
+    m_config->m_refGraph.propertyChanged(this, index);
+    m_config->m_refGraph.propagate();
+}
+
+// objects are created on first access, e.g. when QML reads the property holding a child object, so only
+// the sections actually in use cost a metaobject and an object
 QObject *Node::object() const
 {
+    if (!m_object) {
+        auto *self = const_cast<Node*>(this); // NOLINT
+        self->materialize();
+        if (m_loaded) {
+            self->createObject();
+        }
+    }
     return m_object;
 }
 
+bool Node::isLoaded() const
+{
+    return m_loaded;
+}
+
 void Node::handleSpecialProperty(const QString &name, const QString &value)
 {
     if (name == QLatin1String("$type")) {
@@ -592,7 +924,8 @@ Node *Node::getNode(const QString &key, int *indexOfProperty)
             if (childIdx == -1) {
                 n = nullptr;
             } else {
-                n = n->m_childNodes[childIdx].data();
+                n = n->m_childNodes[childIdx];
+                n->materialize();
             }
         }
     }
@@ -602,7 +935,12 @@ Node *Node::getNode(const QString &key, int *indexOfProperty)
 
 Node *Node::childAt(qsizetype index) const
 {
-    return m_childNodes.at(index).data();
+    return m_childNodes.at(index);
+}
+
+int Node::childCount() const
+{
+    return int(m_childNodes.size());
 }
 
 void Node::updateObjectProperties()
@@ -614,6 +952,7 @@ void Node::updateObjectProperties()
         if (p_idx != -1) {
             auto & p = properties[p_idx];
             p.userTypePropertyIndex = i;
+            cacheNotifySignal(p, i);
             mp.write(m_object, p.value());
             int sig_idx = mp.notifySignalIndex();
             if (sig_idx != -1) {
@@ -628,29 +967,53 @@ void Node::updateObjectProperties()
 
 void Node::notifyPropertyUpdate(int propertyIndex)
 {
-    const QMetaObject *mo = m_object->metaObject();
     auto &p = properties[propertyIndex];
-    bool userType = false;
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-    userType = (typeHint != QMetaType::UnknownType && p.userTypePropertyIndex != -1);
-#else
-    userType = (typeHint.isValid() && p.userTypePropertyIndex != -1);
-#endif
-    if (userType) {
-        propertyIndex = p.userTypePropertyIndex;
-    } else {
-        propertyIndex += mo->propertyOffset();
+    p.emitPending = false;
+    markSnapshotDirty();
+    m_config->scheduleSnapshot();
+    if (!p.notifyMetaObject) {
+        return;
     }
-    int sig_id = mo->property(propertyIndex).notifySignalIndex();
-    int loc_id = sig_id - mo->methodOffset();
-    while (loc_id < 0) {
-        mo = mo->superClass();
-        loc_id = sig_id - mo->methodOffset();
+    void *args[] = { nullptr };
+    QMetaObject::activate(m_object, p.notifyMetaObject, p.notifySignalIndex, args);
+    m_config->m_stats->countSignal();
+}
+
+// effective values of the subtree. Subtrees without changes since the previous call share the previous entries
+std::shared_ptr<const ConfigSnapshot::Entry> Node::snapshot() // NOLINT
+{
+    LIMIT_RECURSION_DEPTH_RET(MAX_RECURSION_DEPTH, nullptr);
+    // snapshots hold all values, so lazily loaded nodes are built once snapshots are published
+    materialize();
+    if (m_snapshot && !m_snapshotDirty) {
+        return m_snapshot;
+    }
+    auto entry = std::make_shared<ConfigSnapshot::Entry>();
+    entry->values.reserve(properties.size());
+    for (const auto &p : qAsConst(properties)) {
+        entry->values.insert(p.key, p.value());
+    }
+    entry->children.reserve(m_childNodes.size());
+    for (const auto &child : qAsConst(m_childNodes)) {
+        // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
+        entry->children.insert(child->m_name, child->snapshot()); // NOLINT
+    }
+    m_snapshot = std::move(entry);
+    m_snapshotDirty = false;
+    return m_snapshot;
+}
+
+bool Node::isSnapshotDirty() const
+{
+    return m_snapshotDirty;
+}
+
+// ancestors of a dirty node are always dirty, so marking stops at the first one already marked
+void Node::markSnapshotDirty()
+{
+    for (Node *n = this; n && !n->m_snapshotDirty; n = n->m_parent) {
+        n->m_snapshotDirty = true;
     }
-    QVector<void*> args;
-    args.append(nullptr);
-    QMetaObject::activate(m_object, mo, loc_id, args.data());
-    p.emitPending = false;
 }
 
  bool Node::isRefObject(const QJsonObject &object) const
@@ -663,22 +1026,53 @@ void Node::notifyPropertyUpdate(int propertyIndex)
     return object.value("$ref").toString();
  }
 
-QString Node::resolvedRefPath(const QString &ref) const
+// converts JSON pointer "#/a/b~1c" to the key path "a.b/c" in a single pass
+QString Node::resolvedRefPath(const QString &ref)
 {
-    auto path = ref.mid(2);
-    return path.replace("/", ".").replace("~0", "~").replace("~1", "/");
+    QString path;
+    path.reserve(ref.size());
+    for (int i = 2; i < ref.size(); ++i) {
+        QChar c = ref.at(i);
+        if (c == QLatin1Char('/')) {
+            path.append(QLatin1Char('.'));
+        } else if (c == QLatin1Char('~') && i + 1 < ref.size() && (ref.at(i + 1) == QLatin1Char('0') || ref.at(i + 1) == QLatin1Char('1'))) {
+            path.append(ref.at(i + 1) == QLatin1Char('0') ? QLatin1Char('~') : QLatin1Char('/'));
+            ++i;
+        } else {
+            path.append(c);
+        }
+    }
+    return path;
 }
 
+// resolves a ref against the root config being loaded. Many refs usually point to a few entries, so results are memoized
+// until the root object is loaded
 QVariant Node::resolvedRef(const QString &path) const
 {
     static const QVariant invalid;
 
-    if (!m_root || !m_root->m_cachedJsonObject) {
+    const Node *root = m_root ? m_root : this;
+    if (!root->m_cachedJsonObject) {
         return invalid;
     }
+    auto it = root->m_refMemo.constFind(path);
+    if (it != root->m_refMemo.constEnd()) {
+        return it.value();
+    }
+    QVariant result = resolvedRef(path, *root->m_cachedJsonObject);
+    root->m_refMemo.insert(path, result);
+    m_config->m_stats->countRefs();
+    return result;
+}
+
+QVariant Node::resolvedRef(const QString &path, const QJsonObject &root) const // NOLINT
+{
+    static const QVariant invalid;
+    LIMIT_RECURSION_DEPTH_RET(MAX_RECURSION_DEPTH, invalid);
+
     QVariant result;
     auto parts = path.split('.');
-    auto object = *m_root->m_cachedJsonObject;
+    auto object = root;
     while (!parts.isEmpty() && object.contains(parts.first())) {
         auto key = parts.first();
         auto v = object.value(key);
@@ -687,7 +1081,8 @@ QVariant Node::resolvedRef(const QString &path) const
             if (!v.isObject()) {
                 result = v.toVariant();
             } else if (isRefObject(v.toObject())) {
-                result = resolvedRef(resolvedRefPath(getRefValue(v.toObject())));
+                // unrolling recursion to iteration makes code less readable. Recursion depth is limited.
+                result = resolvedRef(resolvedRefPath(getRefValue(v.toObject())), root); // NOLINT
             } else {
                 qWarning() << "Reference to Json object not supported.";
                 result = invalid;
@@ -23,9 +23,16 @@
 #pragma once
 
 #include <QString>
+#include <QStringList>
 #include <QList>
 #include <QVariant>
-#include <QSharedPointer>
+#include <QVector>
+#include <QHash>
+#include <QJsonObject>
+
+#include "layermap.h"
+#include "configsnapshot.h"
+#include "configwriter.h"
 
 class JsonQObject;
 class JsonConfig;
@@ -39,64 +46,105 @@ class Node
 public:
     struct NamedMultiValue
     {
+        // type of the generated property. Values of layers are stored as supplied, so saving a layer writes back
+        // what it holds. Reading the property copies a value of this type directly and converts other numbers
+        enum Kind : quint8 { Other, Bool, Double, Integer, String, List };
+
         NamedMultiValue(QString key, QVariant value);
         QString key;
-        QMap<int, QVariant> values;
-        QMap<int, QString> refs;
+        LayerMap<QVariant> values;
+        Kind kind = Other;
+        LayerMap<QString> refs;
         bool emitPending = false;
+        // changes whenever the effective value may have changed. Values are unique process-wide
+        quint64 generation = 0;
         int userTypePropertyIndex = -1;
+        // notify signal of the property: metaobject declaring it and its local index, resolved when the object is created
+        const QMetaObject *notifyMetaObject = nullptr;
+        int notifySignalIndex = -1;
         QMetaObject::Connection listenerConnection;
         const QVariant &value() const;
         int setValue(const QVariant &value);
         void writeValue(const QVariant &value, int level);
+        static Kind kindOf(const QVariant &value);
+        static int storageType(Kind kind);
         void changePriority(int oldPrio, int newPrio);
         bool isRef(int level) const;
         const QString &ref() const;
+        void bumpGeneration();
 
     private:
         bool changeValuePriority(int oldPrio, int newPrio);
         bool changeRefPriority(int oldPrio, int newPrio);
     };
 
-    using NodePtr = QSharedPointer<Node>;
+    // values of a layer object applied to a node
+    struct LayerPatch
+    {
+        int level;
+        QJsonObject object;
+    };
 
-    QList<NamedMultiValue> properties;
+    static quint64 nextGeneration();
+
+    // contiguous, unlike a Qt 5 QList of a large type
+    QVector<NamedMultiValue> properties;
 
     inline const QVariant &valueAt(int index) const { return properties[index].value(); }
 
     void setJsonObject(QJsonObject object);
     QJsonObject toJsonObject(int level) const;
+    LayerTree layerTree(int level) const;
 
     void swapJsonObject(QJsonObject oldObject, QJsonObject object, int level);
     void updateJsonObject(QJsonObject object, int level);
+    void applyLayers(const QList<LayerPatch> &activated, const QList<int> &deactivated);
     bool updateProperty(int index, int level, const QVariant &value);
     void removeProperty(int index, int level);
     void clear();
     void unload(int level);
-    void emitDeferredSignals();
     int indexOfProperty(const QString &name) const;
     int indexOfChild(const QString &name) const;
     QString fullPropertyName(const QString &property) const;
     void setConfig(JsonConfig *newConfig);
     Node *childAt(qsizetype index) const;
+    int childCount() const;
     QObject *object() const;
+    bool isLoaded() const;
     Node *getNode(const QString &key, int *indexOfProperty);
     const QString &name() const;
     bool moveLayer(int oldPriority, int newPriority);
     void notifyPropertyUpdate(int propertyIndex);
+    void propertyChangedHelper(int index);
+    bool updateRefValues(int index, const QVector<QPair<int, QVariant>> &values);
+    void setUserObjectValue(int index, const QVariant &value);
+    static QString resolvedRefPath(const QString &ref);
+    std::shared_ptr<const ConfigSnapshot::Entry> snapshot();
+    bool isSnapshotDirty() const;
 
 private:
-    void propertyChangedHelper(int index);
     void createObject();
+    void materialize();
+    QStringList path() const;
+    QJsonObject lazyJsonObject(int level) const;
+    void writeLayerValue(int index, int level, const QJsonValue &value);
+    void writeUserObjectProperty(int index);
+    void cacheNotifySignal(NamedMultiValue &p, int metaPropertyIndex);
+    void buildKeyIndex();
+    QMetaObject *buildMetaObject(const QList<QByteArray> &types) const;
     void updateObjectProperties();
     static void emitSignalHelper(QObject *object, int signalIndex);
     bool isRefObject(const QJsonObject &object) const;
     QString getRefValue(const QJsonObject &object) const;
-    QString resolvedRefPath(const QString &ref) const;
     QVariant resolvedRef(const QString &path) const;
+    QVariant resolvedRef(const QString &path, const QJsonObject &root) const;
     QJsonObject refToJsonObject(const QString &ref) const;
 
     QObject *m_object = nullptr;
+    bool m_loaded = false;
+    // with lazy loading, a node is built from its part of the root config on first access
+    bool m_lazy = false;
+    QJsonObject m_pendingObject;
     Node *m_parent = nullptr;
     Node *m_root = nullptr;
     QString m_name;
@@ -106,8 +154,17 @@ private:
     QMetaType typeHint { QMetaType::UnknownType };
 #endif
     JsonConfig *m_config = nullptr;
-    QList<NodePtr> m_childNodes;
+    // owned by the NodeArena of the config
+    QVector<Node*> m_childNodes;
+    // key set is fixed once the root layer is loaded, so the indices are built once in setJsonObject
+    QHash<QString, int> m_propertyIndex;
+    QHash<QString, int> m_childIndex;
     QJsonObject *m_cachedJsonObject = nullptr;
+    mutable QHash<QString, QVariant> m_refMemo;
+    // entry of the last published snapshot, rebuilt only if a value in the subtree changed since
+    std::shared_ptr<const ConfigSnapshot::Entry> m_snapshot;
+    bool m_snapshotDirty = true;
+    void markSnapshotDirty();
     void handleSpecialProperty(const QString &name, const QString &value);
 };
 
@@ -0,0 +1,40 @@
+#include "nodearena.h"
+
+#include <new>
+
+NodeArena::~NodeArena()
+{
+    clear();
+}
+
+Node *NodeArena::create()
+{
+    if (m_count == int(m_blocks.size()) * BlockSize) {
+        m_blocks.push_back(std::make_unique<Block>());
+    }
+    Node *n = new (m_blocks[size_t(m_count / BlockSize)]->storage + size_t(m_count % BlockSize) * sizeof(Node)) Node();
+    ++m_count;
+    return n;
+}
+
+void NodeArena::clear()
+{
+    // children are created after their parents, destroy them first
+    for (int i = m_count - 1; i >= 0; --i) {
+        at(i)->~Node();
+    }
+    m_count = 0;
+    if (m_blocks.size() > 1) {
+        m_blocks.resize(1);
+    }
+}
+
+int NodeArena::size() const
+{
+    return m_count;
+}
+
+Node *NodeArena::at(int index) const
+{
+    return std::launder(reinterpret_cast<Node*>(m_blocks[size_t(index / BlockSize)]->storage + size_t(index % BlockSize) * sizeof(Node))); // NOLINT
+}
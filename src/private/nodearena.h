@@ -0,0 +1,36 @@
+#pragma once
+
+#include "node.h"
+
+#include <memory>
+#include <vector>
+
+// Storage of the nodes of a config tree. Nodes are constructed in fixed-size blocks in the order they are created:
+// all children of a node before their own children, and with lazy loading in the order sections are accessed.
+// The nodes are owned by the arena and destroyed all at once by clear(), which keeps the first block for the
+// next tree.
+class NodeArena
+{
+public:
+    NodeArena() = default;
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+    ~NodeArena();
+
+    Node *create();
+    void clear();
+    int size() const;
+
+private:
+    static constexpr int BlockSize = 256;
+
+    struct alignas(Node) Block
+    {
+        unsigned char storage[BlockSize * sizeof(Node)];
+    };
+
+    Node *at(int index) const;
+
+    std::vector<std::unique_ptr<Block>> m_blocks;
+    int m_count = 0;
+};
@@ -0,0 +1,268 @@
+#include "refgraph.h"
+#include "node.h"
+#include "configstats.h"
+
+#include <QDebug>
+#include <QSet>
+#include <QStringList>
+
+void RefGraph::setRoot(Node *root)
+{
+    m_root = root;
+    invalidate();
+}
+
+void RefGraph::setStats(ConfigStats *stats)
+{
+    m_stats = stats;
+}
+
+// the tree was loaded or a section was built, the graph is rebuilt and all refs are recomputed on the next
+// propagation
+void RefGraph::invalidate()
+{
+    m_dirty = true;
+    m_changed.clear();
+    m_added.clear();
+}
+
+void RefGraph::clear()
+{
+    m_targets.clear();
+    m_dependents.clear();
+    m_sources.clear();
+    invalidate();
+}
+
+void RefGraph::addRef(Node *node, int index, int level, const QString &ref)
+{
+    if (m_dirty) {
+        return;
+    }
+    PropertyRef dependent(node, index);
+    unlink(dependent, level);
+    PropertyRef targetRef = target(ref);
+    // resolving the target may build a lazily loaded section, the whole graph is rebuilt then
+    if (m_dirty || !targetRef.first) {
+        return;
+    }
+    link(dependent, level, targetRef);
+    m_added.append(dependent);
+}
+
+void RefGraph::removeRef(Node *node, int index, int level)
+{
+    if (m_dirty) {
+        return;
+    }
+    unlink(PropertyRef(node, index), level);
+}
+
+void RefGraph::link(const PropertyRef &dependent, int level, const PropertyRef &target)
+{
+    m_sources[dependent].append({ level, target });
+    m_dependents[target].append(dependent);
+}
+
+void RefGraph::unlink(const PropertyRef &dependent, int level)
+{
+    auto it = m_sources.find(dependent);
+    if (it == m_sources.end()) {
+        return;
+    }
+    auto &sources = it.value();
+    for (int i = 0; i < sources.size(); ++i) {
+        if (sources.at(i).level != level) {
+            continue;
+        }
+        auto d = m_dependents.find(sources.at(i).target);
+        if (d != m_dependents.end()) {
+            d->removeOne(dependent);
+            if (d->isEmpty()) {
+                m_dependents.erase(d);
+            }
+        }
+        sources.remove(i);
+        break;
+    }
+    if (sources.isEmpty()) {
+        m_sources.erase(it);
+    }
+}
+
+void RefGraph::propertyChanged(Node *node, int index)
+{
+    if (m_propagating || m_dirty) {
+        return;
+    }
+    PropertyRef ref(node, index);
+    if (m_dependents.contains(ref)) {
+        m_changed.append(ref);
+    }
+}
+
+void RefGraph::propagate()
+{
+    if (m_propagating || !m_root) {
+        return;
+    }
+    m_propagating = true;
+    QSet<PropertyRef> affected;
+    if (m_dirty) {
+        build();
+        for (auto it = m_sources.cbegin(); it != m_sources.cend(); ++it) {
+            affected.insert(it.key());
+        }
+    } else if (!m_changed.isEmpty() || !m_added.isEmpty()) {
+        QVector<PropertyRef> queue = m_changed;
+        for (const auto &d : qAsConst(m_added)) {
+            if (!affected.contains(d)) {
+                affected.insert(d);
+                queue.append(d);
+            }
+        }
+        while (!queue.isEmpty()) {
+            PropertyRef r = queue.takeLast();
+            const auto dependents = m_dependents.value(r);
+            for (const auto &d : dependents) {
+                if (!affected.contains(d)) {
+                    affected.insert(d);
+                    queue.append(d);
+                }
+            }
+        }
+    }
+    const auto order = sorted(affected);
+    for (const auto &d : order) {
+        recompute(d);
+    }
+    m_changed.clear();
+    m_added.clear();
+    m_propagating = false;
+}
+
+void RefGraph::build()
+{
+    // resolving ref targets may build lazily loaded nodes, which invalidates the graph again
+    do {
+        m_dirty = false;
+        m_dependents.clear();
+        m_sources.clear();
+        collect(m_root);
+    } while (m_dirty);
+}
+
+// Kahn's algorithm on the affected refs: refs to plain values go first, refs to refs after their targets
+QVector<RefGraph::PropertyRef> RefGraph::sorted(const QSet<PropertyRef> &affected) const
+{
+    QVector<PropertyRef> ret;
+    if (affected.isEmpty()) {
+        return ret;
+    }
+    ret.reserve(affected.size());
+    QHash<PropertyRef, int> inDegree;
+    QVector<PropertyRef> ready;
+    for (const auto &d : affected) {
+        int degree = 0;
+        const auto sources = m_sources.value(d);
+        for (const auto &s : sources) {
+            if (affected.contains(s.target)) {
+                ++degree;
+            }
+        }
+        inDegree.insert(d, degree);
+        if (degree == 0) {
+            ready.append(d);
+        }
+    }
+    while (!ready.isEmpty()) {
+        PropertyRef r = ready.takeLast();
+        ret.append(r);
+        const auto dependents = m_dependents.value(r);
+        for (const auto &d : dependents) {
+            auto it = inDegree.find(d);
+            if (it != inDegree.end() && --it.value() == 0) {
+                ready.append(d);
+            }
+        }
+    }
+    if (ret.size() != affected.size()) {
+        QStringList cycle;
+        for (auto it = inDegree.cbegin(); it != inDegree.cend(); ++it) {
+            if (it.value() > 0) {
+                cycle.append(it.key().first->fullPropertyName(it.key().first->properties[it.key().second].key));
+            }
+        }
+        qWarning().noquote() << "Circular references:" << cycle.join(", ");
+    }
+    return ret;
+}
+
+void RefGraph::collect(Node *node) // NOLINT
+{
+    for (int i = 0; i < node->properties.size(); ++i) {
+        const auto &p = node->properties[i];
+        for (const auto &r : p.refs) {
+            PropertyRef targetRef = target(r.second);
+            if (!targetRef.first) {
+                continue;
+            }
+            link(PropertyRef(node, i), r.first, targetRef);
+        }
+    }
+    for (int i = 0; i < node->childCount(); ++i) {
+        // nodes not built yet have no refs registered, their refs are resolved when they are built
+        if (!node->childAt(i)->isLoaded()) {
+            continue;
+        }
+        // unrolling recursion to iteration makes code less readable. Node tree depth is limited.
+        collect(node->childAt(i)); // NOLINT
+    }
+}
+
+RefGraph::PropertyRef RefGraph::target(const QString &ref)
+{
+    auto it = m_targets.constFind(ref);
+    if (it != m_targets.constEnd()) {
+        return it.value();
+    }
+    PropertyRef result(nullptr, -1);
+    if (m_root) {
+        int index = -1;
+        Node *node = m_root->getNode(Node::resolvedRefPath(ref), &index);
+        if (node && index != -1) {
+            result = PropertyRef(node, index);
+        }
+    }
+    m_targets.insert(ref, result);
+    return result;
+}
+
+QVariant RefGraph::value(const QString &ref)
+{
+    PropertyRef t = target(ref);
+    if (!t.first) {
+        return {};
+    }
+    if (m_stats) {
+        m_stats->countRefs();
+    }
+    return t.first->valueAt(t.second);
+}
+
+void RefGraph::recompute(const PropertyRef &dependent)
+{
+    const auto &p = dependent.first->properties[dependent.second];
+    QVector<QPair<int, QVariant>> values;
+    const auto sources = m_sources.value(dependent);
+    for (const auto &s : sources) {
+        // the layer may have been deactivated or overridden by a plain value since the graph was built
+        if (p.refs.contains(s.level)) {
+            values.append({ s.level, s.target.first->valueAt(s.target.second) });
+        }
+    }
+    if (m_stats) {
+        m_stats->countRefs(int(values.size()));
+    }
+    dependent.first->updateRefValues(dependent.second, values);
+}
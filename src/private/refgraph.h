@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QVector>
+#include <QString>
+#include <QVariant>
+
+class Node;
+class ConfigStats;
+
+// Reverse dependency graph of $ref values. Refs follow the effective value of their target property: when it
+// changes, the dependent properties are recomputed and notified in topological order. The graph is built from
+// the refs of the node tree when the tree is loaded or a section is built. Refs written or dropped by layers
+// then add or remove their edges in place, so only the transitive dependents of a change are recomputed.
+// Cycles are reported and left unresolved.
+class RefGraph
+{
+public:
+    using PropertyRef = QPair<Node*, int>;
+
+    void setRoot(Node *root);
+    void setStats(ConfigStats *stats);
+    void invalidate();
+    void clear();
+
+    // the ref of a property at a layer level was set or dropped
+    void addRef(Node *node, int index, int level, const QString &ref);
+    void removeRef(Node *node, int index, int level);
+
+    void propertyChanged(Node *node, int index);
+    void propagate();
+
+    // target of a ref, resolved once per ref string and memoized until the tree is cleared
+    PropertyRef target(const QString &ref);
+    // current effective value of the ref target
+    QVariant value(const QString &ref);
+
+private:
+    void build();
+    void collect(Node *node); // NOLINT
+    void link(const PropertyRef &dependent, int level, const PropertyRef &target);
+    void unlink(const PropertyRef &dependent, int level);
+    QVector<PropertyRef> sorted(const QSet<PropertyRef> &affected) const;
+    void recompute(const PropertyRef &dependent);
+
+    struct Source
+    {
+        int level;
+        PropertyRef target;
+    };
+
+    Node *m_root = nullptr;
+    ConfigStats *m_stats = nullptr;
+    bool m_dirty = true;
+    bool m_propagating = false;
+    // one entry per source, a dependent referring to a target from two levels is listed twice
+    QHash<PropertyRef, QVector<PropertyRef>> m_dependents;
+    QHash<PropertyRef, QVector<Source>> m_sources;
+    QHash<QString, PropertyRef> m_targets;
+    // targets whose value changed, and dependents with refs added since the last propagation
+    QVector<PropertyRef> m_changed;
+    QVector<PropertyRef> m_added;
+};
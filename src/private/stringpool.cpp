@@ -0,0 +1,80 @@
+#include "stringpool.h"
+
+namespace {
+
+qint64 dataSize(const QString &s)
+{
+    return qint64(s.size()) * qint64(sizeof(QChar));
+}
+
+}
+
+QString StringPool::intern(const QString &s)
+{
+    auto it = m_strings.find(s);
+    if (it != m_strings.end()) {
+        ++m_hits;
+        // a copy of the pooled string duplicates nothing
+        if (!s.isSharedWith(it.key())) {
+            ++it.value();
+            m_savedBytes += dataSize(s);
+        }
+        return it.key();
+    }
+    m_bytes += dataSize(s);
+    m_strings.insert(s, 0);
+    return s;
+}
+
+QVariant StringPool::variant(const QJsonValue &value)
+{
+    if (value.isString()) {
+        QString s = value.toString();
+        return s.size() <= MaxValueLength ? intern(s) : s;
+    }
+    return value.toVariant();
+}
+
+// a string nothing but the pool refers to anymore is detached. The copies it replaced are gone with their
+// holders, so they're not counted as saved anymore
+void StringPool::prune()
+{
+    for (auto it = m_strings.begin(); it != m_strings.end();) {
+        if (it.key().isDetached()) {
+            qint64 size = dataSize(it.key());
+            m_bytes -= size;
+            m_savedBytes -= it.value() * size;
+            it = m_strings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void StringPool::clear()
+{
+    m_strings.clear();
+    m_bytes = 0;
+    m_hits = 0;
+    m_savedBytes = 0;
+}
+
+int StringPool::size() const
+{
+    return int(m_strings.size());
+}
+
+qint64 StringPool::bytes() const
+{
+    return m_bytes;
+}
+
+qint64 StringPool::hits() const
+{
+    return m_hits;
+}
+
+qint64 StringPool::savedBytes() const
+{
+    return m_savedBytes;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QJsonValue>
+#include <QHash>
+#include <QString>
+#include <QVariant>
+
+// Interning pool for property names, node names and short string values. Equal strings returned by the pool
+// share one implicitly shared buffer, so keys and values repeated across nodes and layers are stored once in the
+// node tree. The JSON objects of the layers keep their own copies. Strings no node refers to anymore are dropped
+// by prune(). Used from the thread owning the config only.
+class StringPool
+{
+public:
+    // longer string values are rarely repeated, they are kept as they are
+    static constexpr int MaxValueLength = 64;
+
+    QString intern(const QString &s);
+    // converts a JSON value, interning it if it's a short string
+    QVariant variant(const QJsonValue &value);
+    // drops the strings only the pool refers to
+    void prune();
+    void clear();
+
+    // distinct strings in the pool and the size of their character data in bytes
+    int size() const;
+    qint64 bytes() const;
+    // number of interned strings which were found in the pool, and the character data of the copies replaced by
+    // strings still in the pool
+    qint64 hits() const;
+    qint64 savedBytes() const;
+
+private:
+    // number of copies each string replaced
+    QHash<QString, qint64> m_strings;
+    qint64 m_bytes = 0;
+    qint64 m_hits = 0;
+    qint64 m_savedBytes = 0;
+};
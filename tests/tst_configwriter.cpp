@@ -0,0 +1,193 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+
+#include "private/configwriter.h"
+
+namespace {
+
+// objects nested to the given depth, the top-level object included
+QByteArray nested(int depth)
+{
+    QByteArray ret;
+    for (int i = 1; i < depth; ++i) {
+        ret += "{\"a\":";
+    }
+    ret += "{}";
+    ret += QByteArray(depth - 1, '}');
+    return ret;
+}
+
+bool write(const LayerTree &tree, QByteArray *output, QString *error = nullptr)
+{
+    QBuffer buffer(output);
+    buffer.open(QIODevice::WriteOnly);
+    ConfigWriter writer(&buffer);
+    bool ok = writer.write(tree);
+    if (error) {
+        *error = writer.errorString();
+    }
+    return ok;
+}
+
+QJsonObject readBack(const QByteArray &data)
+{
+    QJsonParseError error;
+    QJsonObject ret = QJsonDocument::fromJson(data, &error).object();
+    if (error.error != QJsonParseError::NoError) {
+        qWarning().noquote() << "Written document doesn't parse:" << error.errorString();
+    }
+    return ret;
+}
+
+}
+
+class TestConfigWriter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void layerTree();
+    void tooDeep();
+    void writeFile();
+    void writeFileTooDeep();
+};
+
+void TestConfigWriter::roundTrip_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("empty") << QByteArray("{}");
+    QTest::newRow("literals") << QByteArray(R"({"t": true, "f": false, "n": null})");
+    QTest::newRow("integers") << QByteArray(R"({"i": 42, "neg": -7, "zero": 0, "big": 9007199254740993})");
+    QTest::newRow("doubles") << QByteArray(R"({"d": 0.1, "neg": -2.5e-3, "large": 1e300, "third": 0.3333333333333333})");
+    QTest::newRow("escapes") << QByteArray(R"({"s": "a\"b\\c/d\be\ff\ng\rh\ti", "ctl": "\u0001\u001f"})");
+    QTest::newRow("unicode") << QByteArray(R"({"ключ": "значение", "中文": "😀", "e": "é"})");
+    QTest::newRow("arrays") << QByteArray(R"({"a": [1, "two", [3, [4]], {"five": 5}, [], {}], "e": []})");
+    QTest::newRow("objects") << QByteArray(R"({"a": {"b": {"c": {"d": "e"}}, "f": {}}, "g": 1})");
+    QTest::newRow("max nesting") << nested(1024);
+}
+
+// what is written reads back with QJsonDocument as the same object
+void TestConfigWriter::roundTrip()
+{
+    QFETCH(QByteArray, data);
+
+    QJsonParseError parseError;
+    QJsonObject object = QJsonDocument::fromJson(data, &parseError).object();
+    QCOMPARE(parseError.error, QJsonParseError::NoError);
+
+    LayerTree tree;
+    tree.json = object;
+    QByteArray output;
+    QString error;
+    QVERIFY2(write(tree, &output, &error), qPrintable(error));
+    QCOMPARE(readBack(output), object);
+}
+
+// values, refs and children of built nodes are merged with the JSON of sections not built yet
+void TestConfigWriter::layerTree()
+{
+    LayerTree section;
+    section.name = QStringLiteral("colors");
+    section.values.push_back({ QStringLiteral("accent"), QStringLiteral("#ff0000"), QString() });
+    section.values.push_back({ QStringLiteral("hovered"), QVariant(), QStringLiteral("#/colors/accent") });
+    section.values.push_back({ QStringLiteral("opacity"), 0.5, QString() });
+
+    LayerTree lazy;
+    lazy.name = QStringLiteral("fonts");
+    lazy.json = QJsonObject { { "size", 12 }, { "families", QJsonArray { "Sans", "Serif" } } };
+
+    LayerTree tree;
+    tree.values.push_back({ QStringLiteral("count"), qlonglong(3), QString() });
+    tree.values.push_back({ QStringLiteral("enabled"), true, QString() });
+    tree.values.push_back({ QStringLiteral("list"), QVariantList { 1, QStringLiteral("x") }, QString() });
+    tree.values.push_back({ QStringLiteral("title"), QStringLiteral("Заголовок"), QString() });
+    tree.children.push_back(section);
+    tree.children.push_back(lazy);
+
+    QJsonObject expected {
+        { "count", 3 },
+        { "enabled", true },
+        { "list", QJsonArray { 1, "x" } },
+        { "title", QStringLiteral("Заголовок") },
+        { "colors", QJsonObject {
+              { "accent", "#ff0000" },
+              { "hovered", QJsonObject { { "$ref", "#/colors/accent" } } },
+              { "opacity", 0.5 } } },
+        { "fonts", lazy.json },
+    };
+
+    QByteArray output;
+    QString error;
+    QVERIFY2(write(tree, &output, &error), qPrintable(error));
+    QCOMPARE(readBack(output), expected);
+}
+
+void TestConfigWriter::tooDeep()
+{
+    LayerTree tree;
+    tree.json = QJsonDocument::fromJson(nested(1024)).object();
+    QVERIFY(!tree.json.isEmpty());
+    // one more level below the deepest object
+    LayerTree deeper;
+    deeper.children.push_back(tree);
+    deeper.children.back().name = QStringLiteral("a");
+
+    QByteArray output;
+    QString error;
+    QVERIFY(!write(deeper, &output, &error));
+    QVERIFY(!error.isEmpty());
+}
+
+void TestConfigWriter::writeFile()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath(QStringLiteral("layer.json"));
+
+    LayerTree tree;
+    tree.json = QJsonObject { { "a", 1 }, { "b", QJsonObject { { "c", "d" } } } };
+    QString error;
+    QVERIFY2(ConfigWriter::writeFile(path, tree, &error), qPrintable(error));
+
+    QFile f(path);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QCOMPARE(readBack(f.readAll()), tree.json);
+}
+
+// a failed write leaves the previous file in place
+void TestConfigWriter::writeFileTooDeep()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath(QStringLiteral("layer.json"));
+    const QByteArray previous = R"({"a": 1})";
+    {
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(previous);
+    }
+
+    LayerTree tree;
+    tree.json = QJsonDocument::fromJson(nested(1024)).object();
+    LayerTree deeper;
+    deeper.children.push_back(tree);
+    deeper.children.back().name = QStringLiteral("a");
+    QString error;
+    QVERIFY(!ConfigWriter::writeFile(path, deeper, &error));
+    QVERIFY(error.contains(QStringLiteral("nested")));
+
+    QFile f(path);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QCOMPARE(f.readAll(), previous);
+}
+
+QTEST_GUILESS_MAIN(TestConfigWriter)
+
+#include "tst_configwriter.moc"
@@ -0,0 +1,190 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+
+#include "private/jsonreader.h"
+
+namespace {
+
+// chunk sizes the device is read with, 1 splits every token and multi-byte character
+const int ChunkSizes[] = { 1, 2, 3, 7, JsonReader::DefaultChunkSize };
+
+bool readDevice(const QByteArray &data, int chunkSize, QJsonObject *result, JsonReader::Error *error)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    JsonReader reader(&buffer, chunkSize);
+    JsonObjectBuilder builder;
+    bool ok = reader.parse(&builder);
+    *result = builder.takeResult();
+    *error = reader.error();
+    return ok;
+}
+
+bool readMemory(const QByteArray &data, QJsonObject *result, JsonReader::Error *error)
+{
+    JsonReader reader(data);
+    JsonObjectBuilder builder;
+    bool ok = reader.parse(&builder);
+    *result = builder.takeResult();
+    *error = reader.error();
+    return ok;
+}
+
+// objects nested to the given depth, the top-level object included
+QByteArray nested(int depth)
+{
+    QByteArray ret;
+    for (int i = 1; i < depth; ++i) {
+        ret += "{\"a\":";
+    }
+    ret += "{}";
+    ret += QByteArray(depth - 1, '}');
+    return ret;
+}
+
+}
+
+class TestJsonReader : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void valid_data();
+    void valid();
+    void malformed_data();
+    void malformed();
+    void errorLocation();
+    void hash();
+};
+
+void TestJsonReader::valid_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("empty object") << QByteArray("{}");
+    QTest::newRow("whitespace") << QByteArray(" \t\r\n{ \"a\" :\n1 , \"b\"\t: [ ] }\r\n");
+    QTest::newRow("literals") << QByteArray(R"({"t": true, "f": false, "n": null})");
+    QTest::newRow("numbers") << QByteArray(R"({"i": 42, "neg": -7, "zero": 0, "d": 1.5, "e": -2.5e-3, "E": 1E10,)"
+                                           R"( "big": 9007199254740993, "huge": 123456789012345678901234567890})");
+    QTest::newRow("escapes") << QByteArray(R"({"s": "a\"b\\c\/d\be\ff\ng\rh\ti", "u": "\u0041\u00e9\u4E2D"})");
+    QTest::newRow("surrogate pair") << QByteArray(R"({"emoji": "\ud83d\ude00", "mixed": "x\uD834\uDD1Ey"})");
+    QTest::newRow("utf-8") << QByteArray("{\"\xd0\xba\xd0\xbb\xd1\x8e\xd1\x87\": \"\xe4\xb8\xad\xe6\x96\x87 \xf0\x9f\x98\x80\"}");
+    QTest::newRow("bom") << QByteArray("\xef\xbb\xbf{\"a\": 1}");
+    QTest::newRow("nested") << QByteArray(R"({"a": {"b": {"c": [1, [2, 3], {"d": "e"}, []]}}, "f": {}})");
+    QTest::newRow("unsorted keys") << QByteArray(R"({"z": 1, "a": 2, "m": {"y": 3, "b": 4}})");
+    QTest::newRow("long string") << "{\"s\": \"" + QByteArray(100000, 'x') + "\"}";
+    QTest::newRow("max nesting") << nested(1024);
+}
+
+// the result is the same as from QJsonDocument, whatever the chunk boundaries
+void TestJsonReader::valid()
+{
+    QFETCH(QByteArray, data);
+
+    QJsonParseError qtError;
+    QJsonObject expected = QJsonDocument::fromJson(data, &qtError).object();
+    QCOMPARE(qtError.error, QJsonParseError::NoError);
+
+    QJsonObject result;
+    JsonReader::Error error;
+    for (int chunkSize : ChunkSizes) {
+        QVERIFY2(readDevice(data, chunkSize, &result, &error), qPrintable(error.toString()));
+        QCOMPARE(result, expected);
+    }
+    QVERIFY2(readMemory(data, &result, &error), qPrintable(error.toString()));
+    QCOMPARE(result, expected);
+}
+
+void TestJsonReader::malformed_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    // rejected by QJsonDocument as well. Some rows are stricter than Qt, e.g. lone surrogate escapes
+    QTest::addColumn<bool>("qtRejects");
+
+    QTest::newRow("empty") << QByteArray() << true;
+    QTest::newRow("whitespace only") << QByteArray(" \n ") << true;
+    QTest::newRow("array") << QByteArray("[1, 2]") << false;
+    QTest::newRow("unterminated object") << QByteArray(R"({"a": 1)") << true;
+    QTest::newRow("missing value") << QByteArray(R"({"a": })") << true;
+    QTest::newRow("missing colon") << QByteArray(R"({"a" 1})") << true;
+    QTest::newRow("trailing comma") << QByteArray(R"({"a": 1,})") << true;
+    QTest::newRow("unquoted key") << QByteArray(R"({a: 1})") << true;
+    QTest::newRow("leading zero") << QByteArray(R"({"a": 01})") << true;
+    QTest::newRow("bad literal") << QByteArray(R"({"a": tru})") << true;
+    QTest::newRow("bad number") << QByteArray(R"({"a": 1.})") << false;
+    QTest::newRow("bad exponent") << QByteArray(R"({"a": 1e})") << false;
+    QTest::newRow("garbage at end") << QByteArray(R"({"a": 1} x)") << true;
+    QTest::newRow("unterminated string") << QByteArray(R"({"a": "abc})") << true;
+    QTest::newRow("illegal escape") << QByteArray(R"({"a": "\x"})") << true;
+    QTest::newRow("short unicode escape") << QByteArray(R"({"a": "\u12"})") << true;
+    QTest::newRow("lone high surrogate") << QByteArray(R"({"a": "\ud83d"})") << false;
+    QTest::newRow("lone low surrogate") << QByteArray(R"({"a": "\ude00"})") << false;
+    QTest::newRow("high surrogate and letter") << QByteArray(R"({"a": "\ud83dx"})") << false;
+    QTest::newRow("invalid utf-8") << QByteArray("{\"a\": \"\xff\"}") << true;
+    QTest::newRow("invalid utf-8 key") << QByteArray("{\"\xfe\": 1}") << true;
+    QTest::newRow("truncated utf-8") << QByteArray("{\"a\": \"\xe4\xb8\"}") << true;
+    QTest::newRow("overlong utf-8") << QByteArray("{\"a\": \"\xc0\xaf\"}") << false;
+    QTest::newRow("encoded surrogate") << QByteArray("{\"a\": \"\xed\xa0\x80\"}") << false;
+    QTest::newRow("partial bom") << QByteArray("\xef\xbb{}") << true;
+    QTest::newRow("too deeply nested") << nested(1025) << true;
+}
+
+// every chunk size reports the same error at the same place
+void TestJsonReader::malformed()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, qtRejects);
+
+    if (qtRejects) {
+        QJsonParseError qtError;
+        QJsonDocument::fromJson(data, &qtError);
+        QVERIFY(qtError.error != QJsonParseError::NoError);
+    }
+
+    QJsonObject result;
+    JsonReader::Error expected;
+    QVERIFY(!readMemory(data, &result, &expected));
+    QVERIFY(expected.isError());
+    for (int chunkSize : ChunkSizes) {
+        JsonReader::Error error;
+        QVERIFY(!readDevice(data, chunkSize, &result, &error));
+        QCOMPARE(error.message, expected.message);
+        QCOMPARE(error.offset, expected.offset);
+        QCOMPARE(error.line, expected.line);
+        QCOMPARE(error.column, expected.column);
+    }
+}
+
+void TestJsonReader::errorLocation()
+{
+    QJsonObject result;
+    JsonReader::Error error;
+    QVERIFY(!readMemory("{\n  \"a\": 1\n  \"b\": 2\n}", &result, &error));
+    QCOMPARE(error.message, QStringLiteral("expected ',' or '}' in an object"));
+    QCOMPARE(error.line, 3);
+    QCOMPARE(error.column, 3);
+}
+
+// the hash covers the whole file, as it's compared with the hash of the file read at once
+void TestJsonReader::hash()
+{
+    QByteArray data = R"({"a": [1, 2, 3], "b": {"c": "d"}})";
+    for (int chunkSize : ChunkSizes) {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        JsonReader reader(&buffer, chunkSize);
+        reader.setHash(&hash);
+        JsonObjectBuilder builder;
+        QVERIFY(reader.parse(&builder));
+        QCOMPARE(hash.result(), QCryptographicHash::hash(data, QCryptographicHash::Md5));
+        QCOMPARE(reader.bytesRead(), qint64(data.size()));
+    }
+}
+
+QTEST_GUILESS_MAIN(TestJsonReader)
+
+#include "tst_jsonreader.moc"
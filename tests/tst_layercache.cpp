@@ -0,0 +1,239 @@
+#include <QtTest>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+
+#include <memory>
+
+#include "private/layercache.h"
+
+namespace {
+
+const QDateTime SourceTime = QDateTime::fromSecsSinceEpoch(1600000000);
+
+bool decode(const QByteArray &data, QJsonObject *object)
+{
+    return LayerCache::decode(reinterpret_cast<const uchar*>(data.constData()), data.size(), object); // NOLINT
+}
+
+QJsonObject sampleObject()
+{
+    return QJsonObject {
+        { "int", 42 },
+        { "negative", -7 },
+        { "big", qint64(9007199254740993LL) },
+        { "double", 1.5 },
+        { "wholeDouble", 2.0 },
+        { "bool", true },
+        { "null", QJsonValue() },
+        { "text", "plain" },
+        { "ключ", "значение" },
+        { "中文", "😀" },
+        { "array", QJsonArray { 1, 2.5, "three", QJsonArray { false, QJsonValue() }, QJsonObject { { "k", "v" } } } },
+        { "object", QJsonObject {
+              { "nested", QJsonObject { { "deep", QJsonArray { QJsonObject { { "é", 1 } } } } } },
+              { "empty", QJsonObject() },
+              { "emptyArray", QJsonArray() } } },
+    };
+}
+
+// objects nested to the given depth, the top-level object included
+QJsonObject nested(int depth)
+{
+    QJsonObject ret;
+    for (int i = 1; i < depth; ++i) {
+        ret = QJsonObject { { "a", ret } };
+    }
+    return ret;
+}
+
+}
+
+class TestLayerCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void roundTrip_data();
+    void roundTrip();
+    void integersAndDoubles();
+    void decodeRejectsMalformed_data();
+    void decodeRejectsMalformed();
+    void hit();
+    void sizeChanged();
+    void contentChanged();
+    void touched();
+    void corrupted();
+    void disabled();
+
+private:
+    void writeSource(const QByteArray &data, const QDateTime &mtime);
+    void store(const QByteArray &data, const QJsonObject &object);
+
+    std::unique_ptr<QTemporaryDir> m_dir;
+    QString m_source;
+    std::unique_ptr<LayerCache> m_cache;
+};
+
+void TestLayerCache::init()
+{
+    m_dir.reset(new QTemporaryDir);
+    QVERIFY(m_dir->isValid());
+    m_source = m_dir->filePath(QStringLiteral("layer.json"));
+    m_cache.reset(new LayerCache(m_dir->filePath(QStringLiteral("cache"))));
+}
+
+void TestLayerCache::writeSource(const QByteArray &data, const QDateTime &mtime)
+{
+    QFile f(m_source);
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(f.write(data), qint64(data.size()));
+    QVERIFY(f.flush());
+    QVERIFY(f.setFileTime(mtime, QFileDevice::FileModificationTime));
+}
+
+void TestLayerCache::store(const QByteArray &data, const QJsonObject &object)
+{
+    writeSource(data, SourceTime);
+    m_cache->store(m_source, data.size(), LayerCache::contentHash(data), object);
+}
+
+void TestLayerCache::roundTrip_data()
+{
+    QTest::addColumn<QJsonObject>("object");
+
+    QTest::newRow("empty") << QJsonObject();
+    QTest::newRow("sample") << sampleObject();
+    QTest::newRow("max nesting") << nested(1024);
+}
+
+void TestLayerCache::roundTrip()
+{
+    QFETCH(QJsonObject, object);
+
+    QJsonObject decoded;
+    QVERIFY(decode(LayerCache::encode(object), &decoded));
+    QCOMPARE(decoded, object);
+}
+
+// the property type of generated objects depends on whether a number is an integer
+void TestLayerCache::integersAndDoubles()
+{
+    QJsonObject decoded;
+    QVERIFY(decode(LayerCache::encode(sampleObject()), &decoded));
+    QCOMPARE(decoded.value("double").toDouble(), 1.5);
+    QCOMPARE(decoded.value("wholeDouble").toVariant().userType(), int(QMetaType::Double));
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    // QJsonValue of Qt 5 holds every number as a double
+    QCOMPARE(decoded.value("int").toVariant().userType(), int(QMetaType::LongLong));
+    QCOMPARE(decoded.value("big").toInteger(), qint64(9007199254740993LL));
+#endif
+}
+
+void TestLayerCache::decodeRejectsMalformed_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    const QByteArray valid = LayerCache::encode(sampleObject());
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("truncated") << valid.left(valid.size() - 1);
+    QTest::newRow("trailing data") << valid + char(0);
+    QTest::newRow("unknown tag") << QByteArray(1, char(0x7f));
+    QTest::newRow("not an object") << QByteArray(1, '\0');
+    QTest::newRow("too deeply nested") << LayerCache::encode(QJsonObject { { "a", nested(1024) } });
+}
+
+void TestLayerCache::decodeRejectsMalformed()
+{
+    QFETCH(QByteArray, data);
+
+    QJsonObject decoded;
+    QVERIFY(!decode(data, &decoded));
+}
+
+void TestLayerCache::hit()
+{
+    const QByteArray data = R"({"a": 1})";
+    const QJsonObject object = sampleObject();
+    store(data, object);
+
+    QJsonObject loaded;
+    QByteArray hash;
+    QVERIFY(m_cache->load(m_source, &loaded, &hash));
+    QCOMPARE(loaded, object);
+    QCOMPARE(hash, LayerCache::contentHash(data));
+    QCOMPARE(m_cache->hits(), 1);
+    QCOMPARE(m_cache->misses(), 0);
+}
+
+void TestLayerCache::sizeChanged()
+{
+    store(R"({"a": 1})", QJsonObject { { "a", 1 } });
+    writeSource(R"({"a": 10})", SourceTime);
+
+    QJsonObject loaded;
+    QVERIFY(!m_cache->load(m_source, &loaded));
+    QCOMPARE(m_cache->misses(), 1);
+}
+
+// same size, but another modification time and content
+void TestLayerCache::contentChanged()
+{
+    store(R"({"a": 1})", QJsonObject { { "a", 1 } });
+    writeSource(R"({"a": 2})", SourceTime.addSecs(10));
+
+    QJsonObject loaded;
+    QVERIFY(!m_cache->load(m_source, &loaded));
+    QCOMPARE(m_cache->misses(), 1);
+}
+
+// another modification time alone doesn't invalidate the entry, the content hash still matches
+void TestLayerCache::touched()
+{
+    const QByteArray data = R"({"a": 1})";
+    store(data, QJsonObject { { "a", 1 } });
+    writeSource(data, SourceTime.addSecs(10));
+
+    QJsonObject loaded;
+    QVERIFY(m_cache->load(m_source, &loaded));
+    QCOMPARE(loaded, QJsonObject({ { "a", 1 } }));
+    // the entry was refreshed with the new time
+    QVERIFY(m_cache->load(m_source, &loaded));
+    QCOMPARE(m_cache->hits(), 2);
+}
+
+void TestLayerCache::corrupted()
+{
+    store(R"({"a": 1})", QJsonObject { { "a", 1 } });
+    const QStringList entries = QDir(m_cache->cacheDir()).entryList(QDir::Files);
+    QCOMPARE(entries.size(), 1);
+    QFile f(QDir(m_cache->cacheDir()).filePath(entries.first()));
+    QVERIFY(f.open(QIODevice::ReadWrite));
+    QVERIFY(f.resize(f.size() - 1));
+    f.close();
+
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("^Corrupted layer cache"));
+    QJsonObject loaded;
+    QVERIFY(!m_cache->load(m_source, &loaded));
+    QCOMPARE(m_cache->misses(), 1);
+}
+
+void TestLayerCache::disabled()
+{
+    LayerCache cache;
+    QVERIFY(!cache.isEnabled());
+    writeSource(R"({"a": 1})", SourceTime);
+    cache.store(m_source, 8, LayerCache::contentHash(R"({"a": 1})"), QJsonObject { { "a", 1 } });
+    QJsonObject loaded;
+    QVERIFY(!cache.load(m_source, &loaded));
+    QVERIFY(!QDir(m_cache->cacheDir()).exists());
+}
+
+QTEST_GUILESS_MAIN(TestLayerCache)
+
+#include "tst_layercache.moc"